@@ -0,0 +1,58 @@
+/*
+  Arenas: one block taken from malloc up front and handed out front to back,
+  everything in it is released at once with arena_reset() or arena_free().
+  
+  Typical use:
+    Arena arena;
+    arena_init(&arena, field_memory(width, height));
+    MineField *field = create_field_in(&arena, width, height, n_mines);
+    arena_reset(&arena);  // the field is gone, the block stays for the next one
+    arena_free(&arena);
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ARENA_ALIGN 16 // of every allocation, enough for any type
+
+typedef struct {
+  uint8_t *base;
+  size_t capacity;
+  size_t used;
+  } Arena;
+
+// the space an allocation of size bytes takes up in an arena
+static inline size_t arena_size(size_t size) {
+  return (size + ARENA_ALIGN-1) & ~(size_t) (ARENA_ALIGN-1);
+  }
+
+static inline bool arena_init(Arena *arena, size_t capacity) {
+  arena->base = malloc(capacity);
+  arena->capacity = arena->base ? capacity : 0;
+  arena->used = 0;
+  return arena->base != NULL;
+  }
+
+// NULL once the arena is full, the memory is not cleared
+static inline void *arena_alloc(Arena *arena, size_t size) {
+  size = arena_size(size);
+  if (size > arena->capacity - arena->used) return NULL;
+  void *p = arena->base + arena->used;
+  arena->used += size;
+  return p;
+  }
+
+static inline void arena_reset(Arena *arena) {
+  arena->used = 0;
+  }
+
+static inline void arena_free(Arena *arena) {
+  free(arena->base);
+  *arena = (Arena) {0};
+  }
+
+#endif
@@ -0,0 +1,328 @@
+/*
+  Microbenchmarks for the engine and the renderer, all boards come from fixed seeds.
+  
+  gcc -O2 bench.c minefield.c solver.c -o bench
+  gcc -O2 -DBENCH_RENDER bench.c minefield.c solver.c endless.c replay.c odds.c -lSDL2 -lSDL2_image -lm -o bench_render
+  
+  ./bench [--json] [--packed] [--max-size N] [--filter NAME]
+  ./bench --check
+  
+  Prints one CSV row (or JSON object) per benchmark, board size and density.
+  --packed runs the engine benchmarks on fields in the bit plane layout.
+  --check instead compares the numbers generate_field writes with a per tile count on boards of
+  many sizes and densities and exits with 1 on any difference, run it in a build with -mavx2
+  too, so that the AVX2 as well as the SSE2 (or wasm simd128) version of the counting is checked.
+  The render benchmarks draw into an offscreen target with the software renderer
+  on SDL's dummy video driver, so they run without a display.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#ifdef BENCH_RENDER
+#define MINES_NO_MAIN
+#include "mines.c"
+#else
+#include "minefield.h"
+#endif
+
+#define BENCH_SEED 12345
+#define MIN_BENCH_NS 200000000LL // keep repeating a benchmark for at least this long
+#define MAX_WALL_NS 2000000000LL // unless setting up the iterations takes longer than this
+#define MAX_ITERATIONS 100000
+
+const int sizes[][2] = {
+  {9, 9}, {16, 16}, {30, 16}, {100, 100}, {500, 500}, {1000, 1000}, {2000, 2000}, {4000, 4000},
+  };
+
+const double densities[] = {0.01, 0.10, 1.0/6, 0.20};
+
+bool packed_fields = false;
+
+typedef struct {
+  bool json;
+  int max_size;
+  const char *filter;
+  } BenchOptions;
+
+typedef struct {
+  long long total_ns;
+  long long min_ns;
+  long long wall_start;
+  int iterations;
+  } BenchResult;
+
+long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+
+BenchResult start_bench() {
+  return (BenchResult) {0, 0, now_ns(), 0};
+  }
+
+void add_sample(BenchResult *result, long long ns) {
+  if (result->iterations == 0 || ns < result->min_ns) result->min_ns = ns;
+  result->total_ns += ns;
+  result->iterations ++;
+  }
+
+bool bench_done(BenchResult *result) {
+  if (result->iterations == 0) return false;
+  if (result->total_ns >= MIN_BENCH_NS || result->iterations >= MAX_ITERATIONS) return true;
+  return now_ns() - result->wall_start >= MAX_WALL_NS;
+  }
+
+void print_header(BenchOptions *options) {
+  if (!options->json) printf("bench,width,height,density,iterations,mean_ns,min_ns,tiles_per_s\n");
+  }
+
+void print_result(BenchOptions *options, const char *name, int width, int height, double density, BenchResult *result) {
+  double mean = (double) result->total_ns / result->iterations;
+  double tiles_per_s = (double) width * height / (mean / 1e9);
+  
+  if (options->json) {
+    printf("{\"bench\": \"%s\", \"width\": %d, \"height\": %d, \"density\": %.4f, \"iterations\": %d, \"mean_ns\": %.0f, \"min_ns\": %lld, \"tiles_per_s\": %.0f}\n",
+      name, width, height, density, result->iterations, mean, result->min_ns, tiles_per_s);
+    }
+  else {
+    printf("%s,%d,%d,%.4f,%d,%.0f,%lld,%.0f\n", name, width, height, density, result->iterations, mean, result->min_ns, tiles_per_s);
+    }
+  fflush(stdout);
+  }
+
+MineField *new_field(int width, int height, double density) {
+  int n_mines = (int) (width * height * density);
+  return packed_fields ? create_packed_field(width, height, n_mines) : create_field(width, height, n_mines);
+  }
+
+// a board generated around its center, not yet opened
+MineField *bench_field(int width, int height, double density, int iteration) {
+  MineField *field = new_field(width, height, density);
+  set_field_seed(field, BENCH_SEED + iteration);
+  generate_field(field, field->n_mines, width/2, height/2);
+  field->state = GAME_PLAYING;
+  return field;
+  }
+
+BenchResult bench_generate(int width, int height, double density) {
+  BenchResult result = start_bench();
+  MineField *field = new_field(width, height, density);
+  while (!bench_done(&result)) {
+    set_field_seed(field, BENCH_SEED + result.iterations);
+    long long start = now_ns();
+    generate_field(field, field->n_mines, width/2, height/2);
+    add_sample(&result, now_ns() - start);
+    }
+  destroy_field(field);
+  return result;
+  }
+
+// the first click, which floods the opening
+BenchResult bench_flood(int width, int height, double density) {
+  BenchResult result = start_bench();
+  while (!bench_done(&result)) {
+    MineField *field = bench_field(width, height, density, result.iterations);
+    long long start = now_ns();
+    dig(field, width/2, height/2);
+    add_sample(&result, now_ns() - start);
+    destroy_field(field);
+    }
+  return result;
+  }
+
+// with every mine flagged, chords every revealed number until the board is open
+BenchResult bench_chord(int width, int height, double density) {
+  BenchResult result = start_bench();
+  while (!bench_done(&result)) {
+    MineField *field = bench_field(width, height, density, result.iterations);
+    dig(field, width/2, height/2);
+    for (int y=0;y<height;y++) {
+      for (int x=0;x<width;x++) {
+        if (IS_MINE(get_tile(field, x, y))) flip_flag(field, x, y);
+        }
+      }
+    
+    long long start = now_ns();
+    bool changed = true;
+    while (changed) {
+      int unopened = field->tiles_unopened;
+      for (int y=0;y<height;y++) {
+        for (int x=0;x<width;x++) run_chord(field, x, y);
+        }
+      changed = field->tiles_unopened != unopened;
+      }
+    add_sample(&result, now_ns() - start);
+    destroy_field(field);
+    }
+  return result;
+  }
+
+BenchResult bench_show_all(int width, int height, double density) {
+  BenchResult result = start_bench();
+  while (!bench_done(&result)) {
+    MineField *field = bench_field(width, height, density, result.iterations);
+    dig(field, width/2, height/2);
+    long long start = now_ns();
+    show_all(field, false);
+    add_sample(&result, now_ns() - start);
+    destroy_field(field);
+    }
+  return result;
+  }
+
+#ifdef BENCH_RENDER
+// full redraw of the cached board for a half opened field
+BenchResult bench_render_full(GameContext *ctx, int width, int height, double density) {
+  BenchResult result = start_bench();
+  MineField *field = bench_field(width, height, density, 0);
+  dig(field, width/2, height/2);
+  
+  MineField *previous = ctx->field;
+  ctx->field = field;
+  SDL_SetRenderTarget(ctx->renderer, ctx->board);
+  while (!bench_done(&result)) {
+    long long start = now_ns();
+    draw_board(ctx);
+    SDL_RenderFlush(ctx->renderer);
+    add_sample(&result, now_ns() - start);
+    }
+  SDL_SetRenderTarget(ctx->renderer, NULL);
+  ctx->field = previous;
+  destroy_field(field);
+  return result;
+  }
+
+// what a frame costs after a single flag: one dirty tile plus the overlays
+BenchResult bench_render_frame(GameContext *ctx, int width, int height, double density) {
+  BenchResult result = start_bench();
+  MineField *field = bench_field(width, height, density, 0);
+  dig(field, width/2, height/2);
+  
+  MineField *previous = ctx->field;
+  ctx->field = field;
+  ctx->redraw_board = true;
+  frame(ctx);
+  while (!bench_done(&result)) {
+    flip_flag(field, 0, 0);
+    long long start = now_ns();
+    frame(ctx);
+    SDL_RenderFlush(ctx->renderer);
+    add_sample(&result, now_ns() - start);
+    }
+  ctx->field = previous;
+  destroy_field(field);
+  return result;
+  }
+#endif
+
+typedef BenchResult (*EngineBench)(int, int, double);
+
+// the numbers of freshly generated and of opened boards, every width up to past two AVX2 blocks
+// covers the vector loops together with every length of the scalar tail
+bool check_counts() {
+  const int heights[] = {1, 2, 3, 16, 33};
+  const double check_densities[] = {0, 0.05, 1.0/6, 0.3, 0.5, 0.9};
+  int boards = 0;
+  int wrong = 0;
+  
+  for (int width=1;width<=130;width++) {
+    for (int h=0;h<(int) (sizeof(heights)/sizeof(heights[0]));h++) {
+      for (int d=0;d<(int) (sizeof(check_densities)/sizeof(check_densities[0]));d++) {
+        for (int seed=0;seed<4;seed++) {
+          int height = heights[h];
+          int n_mines = (int) (width * height * check_densities[d]);
+          if (n_mines >= width * height) n_mines = width * height - 1;
+          
+          // without an opening, with one, and opened
+          MineField *field = create_field(width, height, n_mines);
+          set_field_seed(field, BENCH_SEED + boards);
+          generate_field(field, n_mines, seed > 0 ? width/2 : -1, height/2);
+          if (seed == 3) dig(field, width/2, height/2);
+          if (!check_mine_counts(field)) {
+            printf("wrong numbers on %dx%d with %d mines, seed %d\n", width, height, n_mines, BENCH_SEED + boards);
+            wrong ++;
+            }
+          destroy_field(field);
+          boards ++;
+          }
+        }
+      }
+    }
+  
+  // boards large enough for regions
+  for (int d=0;d<(int) (sizeof(check_densities)/sizeof(check_densities[0]));d++) {
+    MineField *field = create_field(1000, 999, (int) (1000 * 999 * check_densities[d]));
+    set_field_seed(field, BENCH_SEED + boards);
+    generate_field(field, field->n_mines, 500, 500);
+    dig(field, 500, 500);
+    if (!check_mine_counts(field)) {
+      printf("wrong numbers on 1000x999 with %d mines, seed %d\n", field->n_mines, BENCH_SEED + boards);
+      wrong ++;
+      }
+    destroy_field(field);
+    boards ++;
+    }
+  
+  printf("%d boards, %d with wrong numbers\n", boards, wrong);
+  return wrong == 0;
+  }
+
+int main(int argc, char **argv) {
+  BenchOptions options = {false, 4000, NULL};
+  
+  for (int i=1;i<argc;i++) {
+    if (strcmp(argv[i], "--json") == 0) options.json = true;
+    else if (strcmp(argv[i], "--packed") == 0) packed_fields = true;
+    else if (strcmp(argv[i], "--max-size") == 0 && i+1 < argc) options.max_size = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--filter") == 0 && i+1 < argc) options.filter = argv[++i];
+    else if (strcmp(argv[i], "--check") == 0) return check_counts() ? 0 : 1;
+    else {
+      fprintf(stderr, "usage: %s [--json] [--packed] [--max-size N] [--filter NAME] | --check\n", argv[0]);
+      return 1;
+      }
+    }
+  
+  const char *names[] = {"generate", "flood", "chord", "show_all"};
+  EngineBench benches[] = {bench_generate, bench_flood, bench_chord, bench_show_all};
+  
+  print_header(&options);
+  for (int b=0;b<4;b++) {
+    if (options.filter && !strstr(names[b], options.filter)) continue;
+    for (int s=0;s<(int) (sizeof(sizes)/sizeof(sizes[0]));s++) {
+      if (sizes[s][0] > options.max_size || sizes[s][1] > options.max_size) continue;
+      for (int d=0;d<(int) (sizeof(densities)/sizeof(densities[0]));d++) {
+        BenchResult result = benches[b](sizes[s][0], sizes[s][1], densities[d]);
+        print_result(&options, names[b], sizes[s][0], sizes[s][1], densities[d], &result);
+        }
+      }
+    }
+  
+  #ifdef BENCH_RENDER
+  SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+  SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+  
+  GameContext *ctx = create_ctx(&(Options) {.seed = BENCH_SEED, .width = STARTING_FIELD_WIDTH, .height = STARTING_FIELD_HEIGHT, .n_mines = 40});
+  ctx->vsync = true; // frame() draws on every call instead of holding frames back to the frame rate cap
+  
+  for (int s=0;s<(int) (sizeof(sizes)/sizeof(sizes[0]));s++) {
+    if (sizes[s][0] > options.max_size || sizes[s][1] > options.max_size) continue;
+    if (!options.filter || strstr("render_full", options.filter)) {
+      BenchResult result = bench_render_full(ctx, sizes[s][0], sizes[s][1], 1.0/6);
+      print_result(&options, "render_full", sizes[s][0], sizes[s][1], 1.0/6, &result);
+      }
+    if (!options.filter || strstr("render_frame", options.filter)) {
+      BenchResult result = bench_render_frame(ctx, sizes[s][0], sizes[s][1], 1.0/6);
+      print_result(&options, "render_frame", sizes[s][0], sizes[s][1], 1.0/6, &result);
+      }
+    }
+  
+  destroy_ctx(ctx);
+  #endif
+  
+  return 0;
+  }
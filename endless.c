@@ -0,0 +1,347 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "endless.h"
+
+#define PADDED (CHUNK_SIZE+2)
+
+// rounds towards negative infinity, so tile -1 is in chunk -1
+static int floor_div(int a, int b) {
+  return a >= 0 ? a / b : -((-a - 1) / b) - 1;
+  }
+
+static uint32_t chunk_hash(int cx, int cy) {
+  uint64_t k = (uint64_t) (uint32_t) cx << 32 | (uint32_t) cy;
+  k *= 0x9E3779B97F4A7C15ull;
+  return (uint32_t) (k >> 32);
+  }
+
+EndlessField *create_endless(uint64_t seed, double density) {
+  EndlessField *world = calloc(1, sizeof(EndlessField));
+  if (density < ENDLESS_MIN_DENSITY) density = ENDLESS_MIN_DENSITY;
+  if (density > ENDLESS_MAX_DENSITY) density = ENDLESS_MAX_DENSITY;
+  
+  world->seed = seed;
+  world->threshold = (uint32_t) (density * 4294967296.0);
+  world->state = GAME_WAITING;
+  world->capacity = 256;
+  world->slots = calloc(world->capacity, sizeof(Chunk *));
+  world->queue_capacity = 1024;
+  world->queue = malloc(sizeof(int) * world->queue_capacity);
+  return world;
+  }
+
+static void free_chunk(Chunk *c) {
+  free(c->tiles);
+  free(c->packed);
+  free(c);
+  }
+
+void destroy_endless(EndlessField *world) {
+  for (int i=0;i<world->capacity;i++) {
+    if (world->slots[i]) free_chunk(world->slots[i]);
+    }
+  free(world->slots);
+  free(world->queue);
+  free(world);
+  }
+
+// the slot holding the chunk, or the empty slot where it belongs
+static int find_slot(EndlessField *world, int cx, int cy) {
+  int mask = world->capacity - 1;
+  int i = chunk_hash(cx, cy) & mask;
+  while (world->slots[i] && (world->slots[i]->cx != cx || world->slots[i]->cy != cy)) i = (i + 1) & mask;
+  return i;
+  }
+
+static void grow_table(EndlessField *world) {
+  Chunk **old = world->slots;
+  int old_capacity = world->capacity;
+  
+  world->capacity *= 2;
+  world->slots = calloc(world->capacity, sizeof(Chunk *));
+  for (int i=0;i<old_capacity;i++) {
+    if (old[i]) world->slots[find_slot(world, old[i]->cx, old[i]->cy)] = old[i];
+    }
+  free(old);
+  }
+
+// backward shift deletion, keeps the probe sequences intact without tombstones
+static void remove_slot(EndlessField *world, int i) {
+  int mask = world->capacity - 1;
+  int j = i;
+  world->slots[i] = NULL;
+  
+  while (true) {
+    j = (j + 1) & mask;
+    Chunk *c = world->slots[j];
+    if (!c) break;
+    
+    // c may fill the hole unless its home slot lies cyclically in (i, j]
+    int home = chunk_hash(c->cx, c->cy) & mask;
+    bool stays = (i < j) ? (home > i && home <= j) : (home > i || home <= j);
+    if (stays) continue;
+    world->slots[i] = c;
+    world->slots[j] = NULL;
+    i = j;
+    }
+  world->n_chunks --;
+  }
+
+// the mines of a chunk depend only on the seed, its coordinates and the first click
+static void chunk_mines(EndlessField *world, int cx, int cy, uint8_t *mines) {
+  Rng rng;
+  rng_seed(&rng, world->seed ^ ((uint64_t) (uint32_t) cx << 32 | (uint32_t) cy));
+  for (int i=0;i<CHUNK_TILES;i++) mines[i] = rng_next(&rng) < world->threshold;
+  
+  for (int dy=-ENDLESS_SAFE_RADIUS;dy<=ENDLESS_SAFE_RADIUS;dy++) {
+    for (int dx=-ENDLESS_SAFE_RADIUS;dx<=ENDLESS_SAFE_RADIUS;dx++) {
+      int x = world->origin_x + dx;
+      int y = world->origin_y + dy;
+      if (floor_div(x, CHUNK_SIZE) != cx || floor_div(y, CHUNK_SIZE) != cy) continue;
+      mines[(y - cy*CHUNK_SIZE) * CHUNK_SIZE + x - cx*CHUNK_SIZE] = 0;
+      }
+    }
+  }
+
+// numbers at the edge need the mines of the 8 surrounding chunks, which are
+// recomputed from the seed without loading those chunks
+static void generate_chunk(EndlessField *world, Chunk *c) {
+  uint8_t mines[PADDED*PADDED];
+  uint8_t part[CHUNK_TILES];
+  
+  for (int ny=-1;ny<=1;ny++) {
+    for (int nx=-1;nx<=1;nx++) {
+      chunk_mines(world, c->cx + nx, c->cy + ny, part);
+      for (int y=0;y<CHUNK_SIZE;y++) {
+        int py = y + ny*CHUNK_SIZE + 1;
+        if (py < 0 || py >= PADDED) continue;
+        for (int x=0;x<CHUNK_SIZE;x++) {
+          int px = x + nx*CHUNK_SIZE + 1;
+          if (px < 0 || px >= PADDED) continue;
+          mines[py*PADDED + px] = part[y*CHUNK_SIZE + x];
+          }
+        }
+      }
+    }
+  
+  c->tiles = malloc(CHUNK_TILES);
+  for (int y=0;y<CHUNK_SIZE;y++) {
+    for (int x=0;x<CHUNK_SIZE;x++) {
+      uint8_t *m = &mines[(y+1)*PADDED + x+1];
+      Tile *t = &c->tiles[y*CHUNK_SIZE + x];
+      if (*m) *t = TILE_INVA | TILE_MINE;
+      else *t = m[-PADDED-1] + m[-PADDED] + m[-PADDED+1] + m[-1] + m[1] + m[PADDED-1] + m[PADDED] + m[PADDED+1];
+      }
+    }
+  }
+
+// brings a packed, resolved or new chunk back to full tiles
+static void load_chunk(EndlessField *world, Chunk *c) {
+  generate_chunk(world, c);
+  
+  if (c->kind == CHUNK_PACKED) {
+    for (int i=0;i<CHUNK_TILES;i++) {
+      uint8_t bits = c->packed[i/4] >> (i%4*2);
+      if (bits & 1) c->tiles[i] |= TILE_RVLD;
+      if (bits & 2) c->tiles[i] |= TILE_FLAG;
+      }
+    free(c->packed);
+    c->packed = NULL;
+    }
+  else if (c->kind == CHUNK_RESOLVED) {
+    for (int i=0;i<CHUNK_TILES;i++) c->tiles[i] |= IS_MINE(c->tiles[i]) ? TILE_FLAG : TILE_RVLD;
+    }
+  
+  c->kind = CHUNK_FULL;
+  world->n_full ++;
+  }
+
+static Chunk *get_chunk(EndlessField *world, int cx, int cy) {
+  Chunk *c = world->last;
+  if (!c || c->cx != cx || c->cy != cy) {
+    int i = find_slot(world, cx, cy);
+    c = world->slots[i];
+    if (!c) {
+      c = calloc(1, sizeof(Chunk));
+      c->cx = cx;
+      c->cy = cy;
+      c->kind = CHUNK_FULL;
+      c->unresolved = CHUNK_TILES;
+      world->slots[i] = c;
+      world->n_chunks ++;
+      if (world->n_chunks*2 > world->capacity) grow_table(world);
+      }
+    world->last = c;
+    }
+  
+  c->last_used = world->tick;
+  if (!c->tiles) load_chunk(world, c);
+  return c;
+  }
+
+static Tile *tile_at(EndlessField *world, int x, int y, Chunk **chunk) {
+  int cx = floor_div(x, CHUNK_SIZE);
+  int cy = floor_div(y, CHUNK_SIZE);
+  *chunk = get_chunk(world, cx, cy);
+  return &(*chunk)->tiles[(y - cy*CHUNK_SIZE) * CHUNK_SIZE + x - cx*CHUNK_SIZE];
+  }
+
+Tile endless_get_tile(EndlessField *world, int x, int y) {
+  if (world->state == GAME_WAITING) return TILE0;
+  
+  Chunk *c;
+  Tile t = *tile_at(world, x, y, &c);
+  
+  // after a loss every tile reads as if show_all had run, also in chunks loaded later
+  if (world->state == GAME_OVER) {
+    if (IS_FLAG(t)) {
+      if (!IS_MINE(t)) t |= TILE_WFLG;
+      }
+    else t |= TILE_RVLD;
+    }
+  return t;
+  }
+
+static Tile reveal_tile(EndlessField *world, Chunk *c, Tile *t) {
+  *t |= TILE_RVLD;
+  c->touched = true;
+  if (!IS_MINE(*t)) c->unresolved --;
+  world->tiles_opened ++;
+  world->changed = true;
+  return *t;
+  }
+
+static void push_tile(EndlessField *world, int *tail, int x, int y) {
+  if (*tail + 2 > world->queue_capacity) {
+    world->queue_capacity *= 2;
+    world->queue = realloc(world->queue, sizeof(int) * world->queue_capacity);
+    }
+  world->queue[(*tail)++] = x;
+  world->queue[(*tail)++] = y;
+  }
+
+// flood fill like dig_tile, chunks along the way are generated as it reaches them,
+// returns true if a mine was revealed
+static bool dig_endless(EndlessField *world, int x, int y) {
+  Chunk *c;
+  Tile *t = tile_at(world, x, y, &c);
+  
+  if (IS_FLAG(*t) || IS_RVLD(*t)) return false;
+  if (IS_MINE(reveal_tile(world, c, t))) return true;
+  if (!IS_EMPTY(*t)) return false;
+  
+  int head = 0;
+  int tail = 0;
+  push_tile(world, &tail, x, y);
+  
+  while (head < tail) {
+    int qx = world->queue[head++];
+    int qy = world->queue[head++];
+    for (int k=0;k<16;k+=2) {
+      int nx = qx + offsets3x3[k];
+      int ny = qy + offsets3x3[k+1];
+      t = tile_at(world, nx, ny, &c);
+      if (IS_FLAG(*t) || IS_RVLD(*t)) continue;
+      reveal_tile(world, c, t);
+      if (IS_EMPTY(*t)) push_tile(world, &tail, nx, ny);
+      }
+    }
+  return false;
+  }
+
+int endless_open(EndlessField *world, int x, int y) {
+  if (world->state == GAME_WAITING) {
+    world->origin_x = x;
+    world->origin_y = y;
+    world->state = GAME_PLAYING;
+    }
+  else if (world->state != GAME_PLAYING) return world->state;
+  
+  if (dig_endless(world, x, y)) world->state = GAME_OVER;
+  return world->state;
+  }
+
+int endless_chord(EndlessField *world, int x, int y) {
+  if (world->state != GAME_PLAYING) return world->state;
+  
+  Chunk *c;
+  Tile t = *tile_at(world, x, y, &c);
+  if (!IS_RVLD(t)) return world->state;
+  
+  int flags = 0;
+  for (int k=0;k<16;k+=2) {
+    if (IS_FLAG(*tile_at(world, x + offsets3x3[k], y + offsets3x3[k+1], &c))) flags ++;
+    }
+  if (flags != TILE_GET_NUMBER(t)) return world->state;
+  
+  bool lost = false;
+  for (int k=0;k<16;k+=2) lost |= dig_endless(world, x + offsets3x3[k], y + offsets3x3[k+1]);
+  if (lost) world->state = GAME_OVER;
+  return world->state;
+  }
+
+int endless_flag(EndlessField *world, int x, int y) {
+  if (world->state != GAME_PLAYING) return world->state;
+  
+  Chunk *c;
+  Tile *t = tile_at(world, x, y, &c);
+  if (IS_RVLD(*t)) return world->state;
+  
+  *t ^= TILE_FLAG;
+  c->touched = true;
+  world->changed = true;
+  if (IS_FLAG(*t)) world->placed_flags ++;
+  else world->placed_flags --;
+  if (IS_MINE(*t)) c->unresolved += IS_FLAG(*t) ? -1 : 1;
+  return world->state;
+  }
+
+static void pack_chunk(EndlessField *world, Chunk *c) {
+  if (c->unresolved == 0) c->kind = CHUNK_RESOLVED;
+  else {
+    c->kind = CHUNK_PACKED;
+    c->packed = calloc(CHUNK_TILES/4, 1);
+    for (int i=0;i<CHUNK_TILES;i++) {
+      uint8_t bits = (IS_RVLD(c->tiles[i]) ? 1 : 0) | (IS_FLAG(c->tiles[i]) ? 2 : 0);
+      c->packed[i/4] |= bits << (i%4*2);
+      }
+    }
+  free(c->tiles);
+  c->tiles = NULL;
+  world->n_full --;
+  }
+
+static int compare_last_used(const void *a, const void *b) {
+  uint32_t ua = (*(Chunk **) a)->last_used;
+  uint32_t ub = (*(Chunk **) b)->last_used;
+  return (ua > ub) - (ua < ub);
+  }
+
+void endless_trim(EndlessField *world) {
+  uint32_t current = world->tick++;
+  world->changed = false;
+  if (world->n_full <= ENDLESS_MAX_CHUNKS) return;
+  
+  Chunk **full = malloc(sizeof(Chunk *) * world->n_full);
+  int n_full = 0;
+  for (int i=0;i<world->capacity;i++) {
+    if (world->slots[i] && world->slots[i]->tiles) full[n_full++] = world->slots[i];
+    }
+  qsort(full, n_full, sizeof(Chunk *), compare_last_used);
+  
+  // down to three quarters of the budget so this does not run every frame
+  world->last = NULL;
+  for (int k=0;k<n_full && world->n_full > ENDLESS_MAX_CHUNKS*3/4;k++) {
+    Chunk *c = full[k];
+    if (c->last_used == current) break;
+    
+    if (c->touched) pack_chunk(world, c);
+    else {
+      world->n_full --;
+      remove_slot(world, find_slot(world, c->cx, c->cy));
+      free_chunk(c);
+      }
+    }
+  free(full);
+  }
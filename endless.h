@@ -0,0 +1,83 @@
+/*
+  Endless mode: a minefield without edges, stored as a sparse map of square chunks.
+  
+  A chunk is generated from the seed and its coordinates the first time one of its
+  tiles is looked at, so the same seed and first click always give the same world.
+  Chunks the player never touched are dropped again and chunks that are solved or
+  only partly played are packed, so memory stays bounded while exploring.
+  
+  Typical use:
+    EndlessField *world = create_endless(seed, 0.2);
+    endless_open(world, x, y);  // the first open makes the area around (x, y) safe
+    Tile t = endless_get_tile(world, x, y);
+    endless_trim(world);  // once per frame
+    destroy_endless(world);
+*/
+
+#ifndef ENDLESS_H
+#define ENDLESS_H
+
+#include "minefield.h"
+
+#define CHUNK_SIZE 32 // tiles per chunk side
+#define CHUNK_TILES (CHUNK_SIZE*CHUNK_SIZE)
+
+#define CHUNK_FULL     0 // tiles in memory
+#define CHUNK_PACKED   1 // only the revealed and flag bits are kept, 2 per tile
+#define CHUNK_RESOLVED 2 // every safe tile revealed and every mine flagged, nothing is kept
+
+#define ENDLESS_MAX_CHUNKS 1024 // chunks kept unpacked, about 1 MB of tiles
+#define ENDLESS_MIN_DENSITY 0.15 // below this, empty regions can grow without end
+#define ENDLESS_MAX_DENSITY 0.5
+#define ENDLESS_SAFE_RADIUS 2 // the square around the first click that never has mines
+
+typedef struct {
+  int cx;
+  int cy;
+  int kind;
+  bool touched; // something was revealed or flagged, dropping it would lose progress
+  int unresolved; // safe tiles still covered plus mines not flagged
+  uint32_t last_used;
+  Tile *tiles; // CHUNK_TILES tiles, NULL unless the chunk is full
+  uint8_t *packed; // CHUNK_PACKED only
+  } Chunk;
+
+typedef struct {
+  uint64_t seed;
+  uint32_t threshold; // a tile is a mine if its random number is below this
+  int origin_x; // the first click
+  int origin_y;
+  int state;
+  
+  long long tiles_opened;
+  int placed_flags;
+  bool changed; // some tile changed since the last endless_trim
+  
+  // open addressing hash map of the chunks by coordinates
+  Chunk **slots;
+  int capacity;
+  int n_chunks;
+  int n_full;
+  Chunk *last; // the chunk of the previous lookup
+  uint32_t tick;
+  
+  int *queue; // x, y pairs for dig
+  int queue_capacity;
+  } EndlessField;
+
+EndlessField *create_endless(uint64_t seed, double density);
+void destroy_endless(EndlessField *world);
+
+// generates the chunk of the tile if needed, tiles are TILE0 until the first open
+Tile endless_get_tile(EndlessField *world, int x, int y);
+
+// game, these return the game state after the action, the game never ends in GAME_WON
+int endless_open(EndlessField *world, int x, int y);
+int endless_chord(EndlessField *world, int x, int y);
+int endless_flag(EndlessField *world, int x, int y);
+
+// packs or drops the least recently used chunks once more than ENDLESS_MAX_CHUNKS are full,
+// chunks used since the previous call are kept
+void endless_trim(EndlessField *world);
+
+#endif
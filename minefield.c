@@ -0,0 +1,1313 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+
+#include "minefield.h"
+#include "solver.h"
+#include "profile.h"
+
+#ifdef FIELD_MMAP
+#include <sys/mman.h>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+// wall clock time for the no guess budget, clock() would count the CPU time of every thread of the process
+static long long now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  }
+
+const int offsets3x3[] = {-1, 0, -1, -1, 0, -1, 1, -1, 1, 0, 1, 1, 0, 1, -1, 1, 0, 0};
+
+static uint64_t splitmix64(uint64_t *x) {
+  uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+  }
+
+void rng_seed(Rng *rng, uint64_t seed) {
+  uint64_t a = splitmix64(&seed);
+  uint64_t b = splitmix64(&seed);
+  rng->s[0] = (uint32_t) a;
+  rng->s[1] = (uint32_t) (a >> 32);
+  rng->s[2] = (uint32_t) b;
+  rng->s[3] = (uint32_t) (b >> 32);
+  }
+
+static inline uint32_t rotl(uint32_t x, int k) {
+  return (x << k) | (x >> (32 - k));
+  }
+
+uint32_t rng_next(Rng *rng) {
+  uint32_t *s = rng->s;
+  uint32_t result = rotl(s[1] * 5, 7) * 9;
+  uint32_t t = s[1] << 9;
+  
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 11);
+  return result;
+  }
+
+// Lemire's multiply and reject, unbiased unlike rng_next() % n
+uint32_t rng_range(Rng *rng, uint32_t n) {
+  uint64_t m = (uint64_t) rng_next(rng) * n;
+  uint32_t low = (uint32_t) m;
+  if (low < n) {
+    uint32_t threshold = -n % n;
+    while (low < threshold) {
+      m = (uint64_t) rng_next(rng) * n;
+      low = (uint32_t) m;
+      }
+    }
+  return m >> 32;
+  }
+
+#define BIT_GET(plane, i) (((plane)[(i) >> 6] >> ((i) & 63)) & 1)
+#define BIT_SET(plane, i) ((plane)[(i) >> 6] |= 1ull << ((i) & 63))
+#define BIT_CLEAR(plane, i) ((plane)[(i) >> 6] &= ~(1ull << ((i) & 63)))
+
+static MineField *setup_field(MineField *field, int width, int height, int n_mines) {
+  memset(field, 0, sizeof(MineField));
+  int stride = width + 2;
+  
+  field->width = width;
+  field->height = height;
+  field->stride = stride;
+  field->n_mines = n_mines;
+  field->state = GAME_WAITING;
+  field->generated = false;
+  field->all_dirty = true;
+  field->no_guess_budget_ms = NO_GUESS_BUDGET_MS;
+  
+  for (int k=0;k<16;k+=2) field->neighbors[k/2] = offsets3x3[k+1] * stride + offsets3x3[k];
+  return field;
+  }
+
+// the dig queue and the tiles of a byte field, which share one block
+static size_t queue_memory(int width, int height) {
+  return sizeof(int) * width * height + sizeof(Tile) * (width + 2) * (height + 2);
+  }
+
+// the 5 bit planes of count_bbbv
+static size_t scratch_memory(int width, int height) {
+  return sizeof(uint64_t) * (((size_t) (width + 2) * (height + 2) + 63) / 64) * 5;
+  }
+
+// at most one region per 2x2 square, since tiles of two regions are never next to each other
+static int max_regions(int width, int height) {
+  return ((width + 1) / 2) * ((height + 1) / 2);
+  }
+
+// the zero region index, one block, with room for a border entry per tile
+static size_t region_memory(int width, int height) {
+  size_t n = max_regions(width, height);
+  return sizeof(int) * ((size_t) (width + 2) * (height + 2) + width * height + 2*n + 1) + n;
+  }
+
+static void place_regions(MineField *field, int *block) {
+  int n = max_regions(field->width, field->height);
+  field->region_of = block;
+  field->region_border = field->region_of + field->stride * (field->height + 2);
+  field->region_start = field->region_border + field->width * field->height;
+  field->region_zeros = field->region_start + n + 1;
+  field->region_state = (uint8_t *) (field->region_zeros + n);
+  }
+
+bool field_size_fits(int width, int height) {
+  return width >= 1 && height >= 1 && ((long long) width + 2) * ((long long) height + 2) <= INT_MAX - 63;
+  }
+
+MineField *create_field(int width, int height, int n_mines) {
+  if (!field_size_fits(width, height)) return NULL;
+  MineField *field = malloc(sizeof(MineField));
+  
+  // the dig queue and the tiles share one allocation that lives as long as the field
+  int *queue = malloc(queue_memory(width, height));
+  if (!field || !queue) {
+    free(field);
+    free(queue);
+    return NULL;
+    }
+  setup_field(field, width, height, n_mines);
+  field->queue = queue;
+  field->tiles = (Tile *) (field->queue + width * height);
+  return field;
+  }
+
+size_t field_memory(int width, int height) {
+  return arena_size(sizeof(MineField)) + arena_size(queue_memory(width, height)) + arena_size(scratch_memory(width, height))
+       + arena_size(region_memory(width, height));
+  }
+
+MineField *create_field_in(Arena *arena, int width, int height, int n_mines) {
+  if (!field_size_fits(width, height)) return NULL;
+  size_t used = arena->used;
+  MineField *field = arena_alloc(arena, sizeof(MineField));
+  int *queue = arena_alloc(arena, queue_memory(width, height));
+  uint64_t *scratch = arena_alloc(arena, scratch_memory(width, height));
+  int *regions = arena_alloc(arena, region_memory(width, height));
+  if (!field || !queue || !scratch || !regions) {
+    arena->used = used;
+    return NULL;
+    }
+  
+  setup_field(field, width, height, n_mines);
+  field->queue = queue;
+  field->tiles = (Tile *) (queue + width * height);
+  field->scratch = scratch;
+  place_regions(field, regions);
+  field->in_arena = true;
+  return field;
+  }
+
+MineField *create_packed_field(int width, int height, int n_mines) {
+  if (!field_size_fits(width, height)) return NULL;
+  MineField *field = malloc(sizeof(MineField));
+  
+  // the three planes share one allocation, bits past the last tile read as revealed border
+  int n_words = ((width + 2) * (height + 2) + 63) / 64;
+  uint64_t *planes = malloc(sizeof(uint64_t) * n_words * 3);
+  int *queue = malloc(sizeof(int) * PACKED_QUEUE_MIN);
+  if (!field || !planes || !queue) {
+    free(field);
+    free(planes);
+    free(queue);
+    return NULL;
+    }
+  setup_field(field, width, height, n_mines);
+  field->packed = true;
+  field->n_words = n_words;
+  field->mine_bits = planes;
+  field->rvld_bits = field->mine_bits + field->n_words;
+  field->flag_bits = field->rvld_bits + field->n_words;
+  field->queue_capacity = PACKED_QUEUE_MIN;
+  field->queue = queue;
+  return field;
+  }
+
+void destroy_field(MineField *field) {
+  if (field->in_arena) return; // goes with the arena
+  free(field->queue);
+  #ifdef FIELD_MMAP
+  if (field->mapping) munmap(field->mapping, field->mapping_size);
+  else free(field->mine_bits);
+  #else
+  free(field->mine_bits);
+  #endif
+  free(field->scratch);
+  free(field->region_of);
+  free(field);
+  }
+
+void set_field_seed(MineField *field, uint64_t seed) {
+  field->seed = seed;
+  }
+
+// a packed tile as it would be stored in the byte layout, only for tiles inside the field
+static Tile packed_tile(MineField *field, int i) {
+  Tile t = 0;
+  if (BIT_GET(field->mine_bits, i)) t = TILE_INVA | TILE_MINE;
+  else {
+    for (int k=0;k<8;k++) t += BIT_GET(field->mine_bits, i + field->neighbors[k]);
+    }
+  
+  if (BIT_GET(field->flag_bits, i)) t |= TILE_FLAG;
+  if (BIT_GET(field->rvld_bits, i)) t |= TILE_RVLD;
+  return t;
+  }
+
+static inline Tile tile_of(MineField *field, int i) {
+  return field->packed ? packed_tile(field, i) : field_tile(field, i);
+  }
+
+// also works on border tiles
+static inline bool has_flag(MineField *field, int i) {
+  return field->packed ? BIT_GET(field->flag_bits, i) : IS_FLAG(field->tiles[i]);
+  }
+
+// the end of game reveal, applied as tiles are read instead of to the whole field at once
+static Tile shown_tile(MineField *field, Tile t) {
+  if (IS_FLAG(t)) {
+    if (!IS_MINE(t)) t |= TILE_WFLG;
+    }
+  else if (IS_MINE(t) && field->shown == SHOW_FLAGS) t |= TILE_FLAG;
+  else t |= TILE_RVLD;
+  return t;
+  }
+
+Tile get_tile(MineField *field, int x, int y) {
+  if (x < 0 || x >= field->width)  return TILE_INVA;
+  if (y < 0 || y >= field->height) return TILE_INVA;
+  Tile t = tile_of(field, TILE_INDEX(field, x, y));
+  return field->shown ? shown_tile(field, t) : t;
+  }
+
+void mark_dirty(MineField *field, int i) {
+  if (field->dirty_len < DIRTY_MAX) field->dirty[field->dirty_len++] = i;
+  else field->all_dirty = true;
+  }
+
+// appends a word to the move being recorded, dropping the oldest moves to make room
+static void push_word(History *history, uint32_t word) {
+  if (history->overflow) return;
+  while (history->end - history->first > history->mask) {
+    if (history->first == history->move) {
+      history->overflow = true;
+      return;
+      }
+    history->first += history->words[history->first & history->mask] + MOVE_WORDS;
+    }
+  history->words[history->end++ & history->mask] = word;
+  }
+
+// only game actions are recorded, not the solver playing a board while it is generated
+static inline void record_change(MineField *field, int i, int change) {
+  History *history = field->history;
+  if (history && history->move >= 0) push_word(history, (uint32_t) i << 2 | change);
+  }
+
+// reveals a tile that is not revealed yet
+static uint8_t reveal_tile(MineField *field, int i) {
+  mark_dirty(field, i);
+  record_change(field, i, CHANGE_REVEAL);
+  field->tiles_unopened --;
+  if (field->packed) {
+    BIT_SET(field->rvld_bits, i);
+    BIT_CLEAR(field->flag_bits, i);
+    return packed_tile(field, i);
+    }
+  
+  field->tiles[i] |= TILE_RVLD;
+  field->tiles[i] &= ~TILE_FLAG;
+  return field->tiles[i];
+  }
+
+// whether an empty tile is next to (x, y), or a revealed empty tile
+static bool touches_empty(MineField *field, int x, int y, bool revealed) {
+  for (int k=0;k<16;k+=2) {
+    int tx = x+offsets3x3[k];
+    int ty = y+offsets3x3[k+1];
+    if (!IN_FIELD(tx, ty, field)) continue;
+    
+    Tile t = tile_of(field, TILE_INDEX(field, tx, ty));
+    if (IS_EMPTY(t) && (!revealed || IS_RVLD(t))) return true;
+    }
+  return false;
+  }
+
+// 3BV left after a click revealed a safe tile, before any flood from it: an opening counts
+// the first time one of its tiles is revealed, a number only if no opening reveals it.
+// An opening split by a wrong flag counts again for the second part
+static void count_click(MineField *field, int i, Tile t) {
+  int x = i % field->stride - 1;
+  int y = i / field->stride - 1;
+  if (!touches_empty(field, x, y, IS_EMPTY(t))) field->bbbv_left --;
+  }
+
+// a flag or a reveal without a flood on an empty tile, its region cannot be opened as a whole any more
+static void touch_region(MineField *field, int i) {
+  if (field->packed || !field->n_regions || !IS_EMPTY(field->tiles[i])) return;
+  int r = field->region_of[i];
+  if (field->region_state[r] != REGION_FRESH) return;
+  field->region_state[r] = REGION_TOUCHED;
+  record_change(field, r, CHANGE_TOUCH);
+  }
+
+uint8_t reveal(MineField *field, int x, int y) {
+  Tile t = get_tile(field, x, y);
+  if (t == TILE_INVA) return TILE_INVA;
+  
+  int i = TILE_INDEX(field, x, y);
+  if (IS_RVLD(t)) return t;
+  if (IS_FLAG(t)) flip_flag(field, x, y);
+  touch_region(field, i);
+  t = reveal_tile(field, i);
+  if (!IS_MINE(t)) count_click(field, i, t);
+  return t;
+  }
+
+uint8_t check(MineField *field, int x, int y) {
+  return get_tile(field, x, y);
+  }
+
+static int count_bits(const uint64_t *plane, int n_words) {
+  int n = 0;
+  for (int w=0;w<n_words;w++) n += __builtin_popcountll(plane[w]);
+  return n;
+  }
+
+int count_tiles(MineField *field, Tile bit) {
+  if (field->packed) {
+    if (bit == TILE_MINE) return count_bits(field->mine_bits, field->n_words);
+    if (bit == TILE_FLAG) return count_bits(field->flag_bits, field->n_words);
+    // everything outside the field is revealed
+    return count_bits(field->rvld_bits, field->n_words) - (field->n_words*64 - field->width*field->height);
+    }
+  
+  int n = 0;
+  for (int y=0;y<field->height;y++) {
+    int row = TILE_INDEX(field, 0, y);
+    for (int x=0;x<field->width;x++) n += (field_tile(field, row + x) & bit) != 0;
+    }
+  return n;
+  }
+
+bool field_cleared(MineField *field) {
+  if (field->packed) {
+    for (int w=0;w<field->n_words;w++) {
+      if (~(field->rvld_bits[w] | field->mine_bits[w])) return false;
+      }
+    return true;
+    }
+  
+  for (int y=0;y<field->height;y++) {
+    int row = TILE_INDEX(field, 0, y);
+    for (int x=0;x<field->width;x++) {
+      Tile t = field_tile(field, row + x);
+      if (!IS_RVLD(t) && !IS_MINE(t)) return false;
+      }
+    }
+  return true;
+  }
+
+// sets the bits [from, to) of a plane
+static void set_bits(uint64_t *plane, int from, int to, bool value) {
+  for (int i=from;i<to;) {
+    if ((i & 63) == 0 && i + 64 <= to) {
+      plane[i >> 6] = value ? ~0ull : 0;
+      i += 64;
+      }
+    else {
+      if (value) BIT_SET(plane, i);
+      else BIT_CLEAR(plane, i);
+      i ++;
+      }
+    }
+  }
+
+#define MINE_BIT(t) (((t) >> 5) & 1)
+
+// the first clear bit at or after i, the plane has to have one
+static int next_clear(const uint64_t *plane, int i) {
+  uint64_t word = ~plane[i >> 6] >> (i & 63);
+  if (word) return i + __builtin_ctzll(word);
+  for (int w=(i >> 6)+1;;w++) {
+    if (~plane[w]) return w*64 + __builtin_ctzll(~plane[w]);
+    }
+  }
+
+// the last clear bit at or before i
+static int prev_clear(const uint64_t *plane, int i) {
+  uint64_t word = ~plane[i >> 6] << (63 - (i & 63));
+  if (word) return i - __builtin_clzll(word);
+  for (int w=(i >> 6)-1;;w--) {
+    if (~plane[w]) return w*64 + 63 - __builtin_clzll(~plane[w]);
+    }
+  }
+
+// the first set bit in [i, end), or end
+static int next_set(const uint64_t *plane, int i, int end) {
+  while (i < end) {
+    uint64_t word = plane[i >> 6] >> (i & 63);
+    if (word) {
+      i += __builtin_ctzll(word);
+      return i < end ? i : end;
+      }
+    i = (i | 63) + 1;
+    }
+  return end;
+  }
+
+// dst = src spread onto the 8 neighbors of every set bit, rows are stride bits apart,
+// the planes are shifted as if they were one long number
+static void dilate(uint64_t *dst, const uint64_t *src, uint64_t *tmp, int n_words, int stride) {
+  const uint64_t *from = src;
+  uint64_t *to = tmp;
+  for (int pass=0;pass<2;pass++) {
+    int shift = pass == 0 ? 1 : stride;
+    int q = shift / 64;
+    int r = shift % 64;
+    for (int w=0;w<n_words;w++) {
+      uint64_t up = 0, down = 0;
+      if (w-q >= 0) up = from[w-q] << r | (r && w-q-1 >= 0 ? from[w-q-1] >> (64-r) : 0);
+      if (w+q < n_words) down = from[w+q] >> r | (r && w+q+1 < n_words ? from[w+q+1] << (64-r) : 0);
+      to[w] = from[w] | up | down;
+      }
+    from = tmp;
+    to = dst;
+    }
+  }
+
+// moves the run of set bits that starts at start from empty to queued and onto the dig queue,
+// returns the new length of the queue or -1 if it could not grow
+static int queue_run(MineField *field, uint64_t *empty, uint64_t *queued, int start, int len) {
+  // a byte field has a slot per tile, more than it has runs, only a packed one can run out
+  if (field->packed && len == field->queue_capacity) {
+    int *queue = realloc(field->queue, sizeof(int) * field->queue_capacity * 2);
+    if (!queue) return -1;
+    field->queue = queue;
+    field->queue_capacity *= 2;
+    }
+  
+  int end = next_clear(empty, start);
+  set_bits(empty, start, end, false);
+  set_bits(queued, start, end, true);
+  field->queue[len] = start;
+  return len + 1;
+  }
+
+// the 3BV of a generated board, counted on bit planes so it costs about as much on a packed
+// field as on a byte one: the empty tiles are the ones with no mine in their 3x3 square,
+// every safe tile outside the dilated empty tiles counts one and every region of empty tiles one,
+// -1 if there was no memory for the planes or the queue
+static int count_bbbv(MineField *field) {
+  int stride = field->stride;
+  int n_words = (stride * (field->height + 2) + 63) / 64;
+  if (!field->scratch) field->scratch = malloc(scratch_memory(field->width, field->height));
+  if (!field->scratch) return -1;
+  uint64_t *inside = field->scratch;
+  uint64_t *mines = inside + n_words;
+  uint64_t *empty = mines + n_words;
+  uint64_t *near = empty + n_words;
+  uint64_t *tmp = near + n_words;
+  
+  memset(inside, 0, sizeof(uint64_t) * n_words);
+  for (int y=0;y<field->height;y++) set_bits(inside, TILE_INDEX(field, 0, y), TILE_INDEX(field, field->width, y), true);
+  if (field->packed) memcpy(mines, field->mine_bits, sizeof(uint64_t) * n_words);
+  else {
+    int n_tiles = stride * (field->height + 2);
+    for (int w=0;w<n_words;w++) {
+      const Tile *t = field->tiles + w*64;
+      int n = n_tiles - w*64 < 64 ? n_tiles - w*64 : 64;
+      uint64_t bits = 0;
+      for (int b=0;b<n;b++) bits |= (uint64_t) MINE_BIT(t[b]) << b;
+      mines[w] = bits;
+      }
+    }
+  
+  int bbbv = 0;
+  dilate(near, mines, tmp, n_words, stride);
+  for (int w=0;w<n_words;w++) empty[w] = inside[w] & ~near[w];
+  dilate(near, empty, tmp, n_words, stride);
+  for (int w=0;w<n_words;w++) bbbv += __builtin_popcountll(inside[w] & ~mines[w] & ~near[w]);
+  
+  // a byte field labels its regions as they are flooded when they are worth indexing, see index_regions:
+  // large regions only form on boards that are mostly empty, below about one mine in 13 tiles,
+  // on denser ones the index would cost more than the floods it saves
+  int *region_of = NULL;
+  int n_regions = 0;
+  if (field->region_of && 2 * count_bits(empty, n_words) >= field->width * field->height) region_of = field->region_of;
+  
+  // flood every region of empty tiles a run of a row at a time, a run moves from the
+  // empty plane to the queued one when it is found, so the dig queue holds it only once
+  uint64_t *queued = tmp;
+  memset(queued, 0, sizeof(uint64_t) * n_words);
+  bool failed = false;
+  for (int w=0;w<n_words && !failed;w++) {
+    while (empty[w] && !failed) {
+      int len = queue_run(field, empty, queued, w*64 + __builtin_ctzll(empty[w]), 0);
+      bbbv ++;
+      if (region_of) field->region_zeros[n_regions] = 0;
+      
+      while (len > 0) {
+        int l = field->queue[--len];
+        int r = next_clear(queued, l);
+        set_bits(queued, l, r, false);
+        if (region_of) {
+          for (int i=l;i<r;i++) region_of[i] = n_regions;
+          field->region_zeros[n_regions] += r - l;
+          }
+        
+        // the runs that touch it in the rows above and below, diagonals included
+        for (int d=-stride;d<=stride && len >= 0;d+=2*stride) {
+          for (int n=next_set(empty, l-1+d, r+1+d);n<r+1+d && len >= 0;n=next_set(empty, n, r+1+d)) {
+            len = queue_run(field, empty, queued, prev_clear(empty, n) + 1, len);
+            }
+          }
+        }
+      failed = len < 0;
+      n_regions ++;
+      }
+    }
+  if (region_of && !failed) field->n_regions = n_regions;
+  
+  // boards after the first reuse the planes, except on a packed field, which is meant to stay small
+  if (field->packed) {
+    free(field->scratch);
+    field->scratch = NULL;
+    }
+  return failed ? -1 : bbbv;
+  }
+
+static void count_row_scalar(const Tile *up, Tile *row, const Tile *down, int x, int width) {
+  for (;x<width;x++) {
+    if (IS_MINE(row[x])) continue;
+    row[x] = MINE_BIT(up[x-1]) + MINE_BIT(up[x]) + MINE_BIT(up[x+1])
+           + MINE_BIT(row[x-1]) + MINE_BIT(row[x+1])
+           + MINE_BIT(down[x-1]) + MINE_BIT(down[x]) + MINE_BIT(down[x+1]);
+    }
+  }
+
+// what count_row computes, one tile and its 8 neighbors at a time, kept as the reference it is checked against
+static Tile count_tile_reference(const MineField *field, int t) {
+  if (IS_MINE(field->tiles[t])) return TILE_INVA | TILE_MINE;
+  uint8_t neighbors = 0;
+  for (int k=0;k<8;k++) {
+    if (IS_MINE(field->tiles[t + field->neighbors[k]])) neighbors ++;
+    }
+  return neighbors;
+  }
+
+// replaces every tile of a row that is not a mine with the number of mines around it,
+// the rows above and below may be border rows
+static void count_row(const Tile *up, Tile *row, const Tile *down, int width) {
+  int x = 0;
+  
+#if defined(__AVX2__)
+  const __m256i one = _mm256_set1_epi8(1);
+  const __m256i mine = _mm256_set1_epi8(TILE_MINE);
+  #define BITS(p) _mm256_and_si256(_mm256_srli_epi16(_mm256_loadu_si256((const __m256i *) (p)), 5), one)
+  for (;x+32<=width;x+=32) {
+    __m256i n = _mm256_add_epi8(_mm256_add_epi8(BITS(up+x-1), BITS(up+x)), BITS(up+x+1));
+    n = _mm256_add_epi8(n, _mm256_add_epi8(BITS(row+x-1), BITS(row+x+1)));
+    n = _mm256_add_epi8(n, _mm256_add_epi8(_mm256_add_epi8(BITS(down+x-1), BITS(down+x)), BITS(down+x+1)));
+    
+    __m256i t = _mm256_loadu_si256((const __m256i *) (row+x));
+    __m256i is_mine = _mm256_cmpeq_epi8(_mm256_and_si256(t, mine), mine);
+    _mm256_storeu_si256((__m256i *) (row+x), _mm256_blendv_epi8(n, t, is_mine));
+    }
+  #undef BITS
+#elif defined(__SSE2__)
+  const __m128i one = _mm_set1_epi8(1);
+  const __m128i mine = _mm_set1_epi8(TILE_MINE);
+  #define BITS(p) _mm_and_si128(_mm_srli_epi16(_mm_loadu_si128((const __m128i *) (p)), 5), one)
+  for (;x+16<=width;x+=16) {
+    __m128i n = _mm_add_epi8(_mm_add_epi8(BITS(up+x-1), BITS(up+x)), BITS(up+x+1));
+    n = _mm_add_epi8(n, _mm_add_epi8(BITS(row+x-1), BITS(row+x+1)));
+    n = _mm_add_epi8(n, _mm_add_epi8(_mm_add_epi8(BITS(down+x-1), BITS(down+x)), BITS(down+x+1)));
+    
+    __m128i t = _mm_loadu_si128((const __m128i *) (row+x));
+    __m128i is_mine = _mm_cmpeq_epi8(_mm_and_si128(t, mine), mine);
+    _mm_storeu_si128((__m128i *) (row+x), _mm_or_si128(_mm_and_si128(is_mine, t), _mm_andnot_si128(is_mine, n)));
+    }
+  #undef BITS
+#elif defined(__wasm_simd128__)
+  const v128_t one = wasm_i8x16_splat(1);
+  const v128_t mine = wasm_i8x16_splat(TILE_MINE);
+  #define BITS(p) wasm_v128_and(wasm_u8x16_shr(wasm_v128_load(p), 5), one)
+  for (;x+16<=width;x+=16) {
+    v128_t n = wasm_i8x16_add(wasm_i8x16_add(BITS(up+x-1), BITS(up+x)), BITS(up+x+1));
+    n = wasm_i8x16_add(n, wasm_i8x16_add(BITS(row+x-1), BITS(row+x+1)));
+    n = wasm_i8x16_add(n, wasm_i8x16_add(wasm_i8x16_add(BITS(down+x-1), BITS(down+x)), BITS(down+x+1)));
+    
+    v128_t t = wasm_v128_load(row+x);
+    v128_t is_mine = wasm_i8x16_eq(wasm_v128_and(t, mine), mine);
+    wasm_v128_store(row+x, wasm_v128_bitselect(t, n, is_mine));
+    }
+  #undef BITS
+#endif
+  
+  count_row_scalar(up, row, down, x, width);
+  }
+
+// keeps an opening around (opening_x, opening_y) free of mines, the byte layout marks
+// its tiles with TILE8 and a packed field with the flag plane
+static void exclude_tile(MineField *field, int x, int y) {
+  if (field->packed) BIT_SET(field->flag_bits, TILE_INDEX(field, x, y));
+  else TILE_AT(field, x, y) = TILE8;
+  }
+
+static void carve_opening(MineField *field, int n_mines, int opening_x, int opening_y) {
+  int width = field->width;
+  int height = field->height;
+  int dx, dy, x, y;
+  
+  int opening_size = n_mines > 0 ? width * height / n_mines / 3 : width * height;
+  if (opening_size <= 2) opening_size = 3;
+  
+  int opening_radius = 1;
+  exclude_tile(field, opening_x, opening_y);
+  
+  // centers outside the field are clamped onto its edge, so every step carves something
+  for (int n=0;n<opening_size;n++) {
+    dx = rng_range(&field->rng, opening_radius) - opening_radius/2;
+    dy = rng_range(&field->rng, opening_radius) - opening_radius/2;
+    x = opening_x + dx;
+    y = opening_y + dy;
+    
+    if (x < 0) x = 0;
+    if (x >= width) x = width-1;
+    if (y < 0) y = 0;
+    if (y >= height) y = height-1;
+    
+    int tx, ty;
+    for (int k=0;k<18;k+=2) {
+      tx = x+offsets3x3[k];
+      ty = y+offsets3x3[k+1];
+      if (!IN_FIELD(tx, ty, field)) continue;
+      exclude_tile(field, tx, ty);
+      }
+    
+    opening_radius ++;
+    }
+  }
+
+// mines are placed by rejection sampling, which needs no memory beyond the planes,
+// placing the rarer of mines and safe tiles keeps the expected draws per placement under two
+static void generate_packed(MineField *field, int n_mines, int opening_x, int opening_y) {
+  int width = field->width;
+  int height = field->height;
+  int n_words = field->n_words;
+  
+  memset(field->mine_bits, 0, sizeof(uint64_t) * n_words);
+  memset(field->flag_bits, 0, sizeof(uint64_t) * n_words);
+  memset(field->rvld_bits, 0xff, sizeof(uint64_t) * n_words);
+  for (int y=0;y<height;y++) set_bits(field->rvld_bits, TILE_INDEX(field, 0, y), TILE_INDEX(field, width, y), false);
+  
+  if (opening_x >= 0 && opening_y >= 0) carve_opening(field, n_mines, opening_x, opening_y);
+  int n_candidates = width * height - count_bits(field->flag_bits, n_words);
+  if (n_mines > n_candidates) n_mines = n_candidates;
+  
+  bool invert = n_mines > n_candidates / 2;
+  if (invert) {
+    for (int y=0;y<height;y++) set_bits(field->mine_bits, TILE_INDEX(field, 0, y), TILE_INDEX(field, width, y), true);
+    for (int w=0;w<n_words;w++) field->mine_bits[w] &= ~field->flag_bits[w];
+    }
+  
+  int n_place = invert ? n_candidates - n_mines : n_mines;
+  for (int n=0;n<n_place;) {
+    int x = rng_range(&field->rng, width);
+    int y = rng_range(&field->rng, height);
+    int i = TILE_INDEX(field, x, y);
+    if (BIT_GET(field->flag_bits, i) || BIT_GET(field->mine_bits, i) != invert) continue;
+    
+    if (invert) BIT_CLEAR(field->mine_bits, i);
+    else BIT_SET(field->mine_bits, i);
+    n ++;
+    }
+  
+  memset(field->flag_bits, 0, sizeof(uint64_t) * n_words);
+  field->placed_mines = n_mines;
+  }
+
+static void generate_board(MineField *field, int n_mines, int opening_x, int opening_y) {
+  int width = field->width;
+  int height = field->height;
+  int stride = field->stride;
+  Tile *tiles = field->tiles;
+  
+  field->generated = true;
+  field->shown = SHOW_NONE;
+  field->n_regions = 0;
+  field->placed_flags = 0;
+  field->correct_flags = 0;
+  field->tiles_unopened = width * height;
+  field->dirty_len = 0;
+  field->all_dirty = true;
+  if (field->packed) {
+    generate_packed(field, n_mines, opening_x, opening_y);
+    return;
+    }
+  
+  memset(tiles, TILE_BORDER, stride);
+  memset(tiles + (height+1) * stride, TILE_BORDER, stride);
+  for (int y=0;y<height;y++) {
+    Tile *row = tiles + TILE_INDEX(field, -1, y);
+    row[0] = TILE_BORDER;
+    memset(row+1, TILE_INVA, width);
+    row[width+1] = TILE_BORDER;
+    }
+  
+  int x, y;
+  if (opening_x >= 0 && opening_y >= 0) carve_opening(field, n_mines, opening_x, opening_y);
+  
+  // partial Fisher-Yates shuffle over the tiles outside the opening,
+  // the dig queue is free until the first dig and holds the candidates
+  int *candidates = field->queue;
+  int n_candidates = 0;
+  for (y=0;y<height;y++) {
+    Tile *row = &TILE_AT(field, 0, y);
+    int start = TILE_INDEX(field, 0, y);
+    for (x=0;x<width;x++) {
+      if (row[x] != TILE8) candidates[n_candidates++] = start + x;
+      }
+    }
+  
+  if (n_mines > n_candidates) n_mines = n_candidates;
+  for (int n=0;n<n_mines;n++) {
+    int k = n + rng_range(&field->rng, n_candidates - n);
+    int t = candidates[k];
+    candidates[k] = candidates[n];
+    candidates[n] = t;
+    tiles[t] |= TILE_MINE;
+    }
+  field->placed_mines = n_mines;
+  
+  // numbers are written in place, this only reads the mine bits, which it never changes
+  for (y=0;y<height;y++) {
+    Tile *row = &TILE_AT(field, 0, y);
+    count_row(row - stride, row, row + stride, width);
+    }
+  }
+
+bool check_mine_counts(MineField *field) {
+  if (field->packed || !field->generated) return true;
+  int stride = field->stride;
+  Tile *copy = malloc(stride);
+  bool ok = true;
+  for (int y=-1;y<=field->height && ok;y++) {
+    Tile *row = &TILE_AT(field, -1, y);
+    if (y < 0 || y == field->height) {
+      for (int x=0;x<stride;x++) ok = ok && row[x] == TILE_BORDER;
+      continue;
+      }
+    ok = ok && row[0] == TILE_BORDER && row[stride-1] == TILE_BORDER;
+    
+    // count_row again on a copy of the row that only keeps its mines, the game may have revealed or flagged tiles since
+    for (int x=0;x<stride;x++) copy[x] = IS_MINE(row[x]) ? TILE_INVA | TILE_MINE : TILE_INVA;
+    count_row(row - stride + 1, copy + 1, row + stride + 1, field->width);
+    for (int x=0;x<field->width;x++) {
+      Tile expected = count_tile_reference(field, TILE_INDEX(field, x, y));
+      ok = ok && copy[x+1] == expected && (row[x+1] & ~(TILE_RVLD | TILE_FLAG | TILE_WFLG)) == expected;
+      }
+    }
+  free(copy);
+  return ok;
+  }
+
+// covers every tile again after the solver played the board
+static void reset_progress(MineField *field) {
+  for (int y=0;y<field->height;y++) {
+    Tile *row = &TILE_AT(field, 0, y);
+    for (int x=0;x<field->width;x++) row[x] &= ~(TILE_RVLD | TILE_FLAG);
+    }
+  field->placed_flags = 0;
+  field->correct_flags = 0;
+  field->tiles_unopened = field->width * field->height;
+  field->dirty_len = 0;
+  field->all_dirty = true;
+  }
+
+// finds the border of every large region count_bbbv labeled: the numbers next to it, a number borders up
+// to 4 regions. They are the tiles next to a mine and next to an empty tile, from the planes count_bbbv
+// leaves in field->scratch, whose empty plane its flood cleared. The first pass counts them, the second
+// places them and moves every start on by its count. Smaller regions are left to the flood and have none
+static void index_regions(MineField *field) {
+  int stride = field->stride;
+  int n_words = (stride * (field->height + 2) + 63) / 64;
+  uint64_t *inside = field->scratch;
+  uint64_t *mines = inside + n_words;
+  uint64_t *numbers = mines + n_words;
+  uint64_t *near = numbers + n_words;
+  dilate(numbers, mines, near + n_words, n_words, stride);
+  for (int w=0;w<n_words;w++) numbers[w] &= inside[w] & near[w] & ~mines[w];
+  
+  const Tile *tiles = field->tiles;
+  int n_regions = field->n_regions;
+  field->n_regions = 0;
+  
+  const int *region_of = field->region_of;
+  const int *zeros = field->region_zeros;
+  int *border = field->region_border;
+  int *start = field->region_start;
+  memset(start, 0, sizeof(int) * (n_regions + 1));
+  for (int pass=0;pass<2;pass++) {
+    for (int w=0;w<n_words;w++) {
+      for (uint64_t bits=numbers[w];bits;bits&=bits-1) {
+        int i = w*64 + __builtin_ctzll(bits);
+        
+        int seen[8];
+        int n_seen = 0;
+        for (int k=0;k<8;k++) {
+          int n = i + field->neighbors[k];
+          if (!IS_EMPTY(tiles[n])) continue;
+          int r = region_of[n];
+          if (zeros[r] <= DIRTY_MAX) continue;
+          bool known = false;
+          for (int q=0;q<n_seen;q++) known |= seen[q] == r;
+          if (known) continue;
+          seen[n_seen++] = r;
+          
+          if (pass == 0) start[r+1] ++;
+          else border[start[r]++] = i;
+          }
+        }
+      }
+    
+    if (pass == 0) {
+      for (int r=0;r<n_regions;r++) start[r+1] += start[r];
+      if (start[n_regions] > field->width * field->height) return; // more than it has room for, the board floods as usual
+      }
+    }
+  for (int r=n_regions;r>0;r--) start[r] = start[r-1];
+  start[0] = 0;
+  
+  memset(field->region_state, REGION_FRESH, n_regions);
+  field->n_regions = n_regions;
+  }
+
+bool generate_field(MineField *field, int n_mines, int opening_x, int opening_y) {
+  PROFILE_SCOPE(PROFILE_GENERATE);
+  rng_seed(&field->rng, field->seed);
+  generate_board(field, n_mines, opening_x, opening_y);
+  
+  field->guess_free = false;
+  field->no_guess_attempts = 0;
+  if (field->no_guess && !field->packed && IN_FIELD(opening_x, opening_y, field)) {
+    // the rng carries on between attempts, so unless the budget runs out the board depends only on the seed,
+    // and on the number of attempts in any case
+    long long deadline = now_ms() + field->no_guess_budget_ms;
+    field->no_guess_attempts = 1;
+    while (true) {
+      field->guess_free = solve_field(field, opening_x, opening_y);
+      reset_progress(field);
+      if (field->guess_free) break;
+      if (field->no_guess_fixed_attempts > 0 ? field->no_guess_attempts >= field->no_guess_fixed_attempts : now_ms() >= deadline) break;
+      generate_board(field, n_mines, opening_x, opening_y);
+      field->no_guess_attempts ++;
+      }
+    }
+  
+  // a region has to be larger than the dirty list to be opened as a whole,
+  // without memory for the index the field has no regions and floods tile by tile
+  if (!field->packed && field->width * field->height > DIRTY_MAX && !field->region_of) {
+    int *block = malloc(region_memory(field->width, field->height));
+    if (block) place_regions(field, block);
+    }
+  
+  field->bbbv = count_bbbv(field);
+  if (field->bbbv < 0) {
+    // out of memory, the board is dropped and the next field_open tries again
+    field->bbbv = 0;
+    field->generated = false;
+    return false;
+    }
+  field->bbbv_left = field->bbbv;
+  if (field->n_regions) index_regions(field);
+  return true;
+  }
+
+// returns the field to the waiting state, the next field_open generates a new board
+void clear_field(MineField *field) {
+  field->generated = false;
+  field->state = GAME_WAITING;
+  field->placed_mines = 0;
+  field->placed_flags = 0;
+  field->correct_flags = 0;
+  field->bbbv = 0;
+  field->bbbv_left = 0;
+  field->events = 0;
+  field->shown = SHOW_NONE;
+  field->n_regions = 0;
+  field->rewinds = 0;
+  field->all_dirty = true;
+  }
+
+// dig_tile of a packed field, whose queue only has to hold the frontier of the flood
+static bool dig_packed(MineField *field, int i) {
+  if (BIT_GET(field->flag_bits, i) || BIT_GET(field->rvld_bits, i)) return false;
+  Tile t = reveal_tile(field, i);
+  if (IS_MINE(t)) return true;
+  count_click(field, i, t);
+  if (!IS_EMPTY(t)) return false;
+  
+  int head = 0;
+  int len = 1;
+  field->queue[0] = i;
+  
+  while (len > 0) {
+    int c = field->queue[head];
+    head = (head + 1) & (field->queue_capacity - 1);
+    len --;
+    
+    for (int k=0;k<8;k++) {
+      int n = c + field->neighbors[k];
+      if (BIT_GET(field->flag_bits, n) || BIT_GET(field->rvld_bits, n)) continue;
+      if (!IS_EMPTY(reveal_tile(field, n))) continue;
+      
+      if (len == field->queue_capacity) {
+        // unwrap into a ring twice the size, without memory the flood stops and leaves the rest covered
+        int *queue = malloc(sizeof(int) * field->queue_capacity * 2);
+        if (!queue) return false;
+        for (int q=0;q<len;q++) queue[q] = field->queue[(head + q) & (field->queue_capacity - 1)];
+        free(field->queue);
+        field->queue = queue;
+        field->queue_capacity *= 2;
+        head = 0;
+        }
+      field->queue[(head + len) & (field->queue_capacity - 1)] = n;
+      len ++;
+      }
+    }
+  return false;
+  }
+
+// what the flood from the revealed empty tile i would reveal, if no tile of its region was flagged
+// or revealed before: the region is marked open, which reveals its empty tiles, and only its border
+// is revealed tile by tile, along with the empty tiles next to it. So around a number every tile
+// reads as stored, only the inner tiles of the region need field_tile. Regions no larger than the
+// dirty list are left to the flood, which costs little and marks the tiles it reveals
+static bool open_region(MineField *field, int i) {
+  if (!field->n_regions) return false;
+  int r = field->region_of[i];
+  if (field->region_state[r] != REGION_FRESH) return false;
+  if (field->region_zeros[r] <= DIRTY_MAX) return false;
+  int *border = field->region_border + field->region_start[r];
+  int n_border = field->region_start[r+1] - field->region_start[r];
+  
+  field->region_state[r] = REGION_OPEN;
+  record_change(field, r, CHANGE_OPEN);
+  field->tiles_unopened -= field->region_zeros[r] - 1; // i is revealed already
+  field->all_dirty = true;
+  for (int k=0;k<n_border;k++) {
+    for (int d=0;d<8;d++) {
+      int n = border[k] + field->neighbors[d];
+      Tile t = field->tiles[n];
+      if (!IS_EMPTY(t) || IS_RVLD(t) || field->region_of[n] != r) continue;
+      field->tiles[n] = t | TILE_RVLD;
+      record_change(field, n, CHANGE_REVEAL);
+      }
+    
+    Tile t = field->tiles[border[k]];
+    if (IS_FLAG(t) || IS_RVLD(t)) continue;
+    reveal_tile(field, border[k]);
+    }
+  return true;
+  }
+
+// flood fill over field->queue, returns true if a mine was revealed
+bool dig_tile(MineField *field, int i) {
+  if (field->packed) return dig_packed(field, i);
+  Tile t = field_tile(field, i);
+  
+  if (IS_FLAG(t)) return false;
+  if (IS_RVLD(t)) return false; // also stops at the border
+  if (IS_MINE(reveal_tile(field, i))) return true;
+  count_click(field, i, t);
+  if (!IS_EMPTY(t)) return false;
+  if (open_region(field, i)) return false;
+  
+  // only empty tiles are queued and every tile is revealed before it is queued,
+  // so the queue never holds more than width*height entries. The flood stays in the region
+  // of i, which is not open, so it can read the tiles as they are stored
+  int *queue = field->queue;
+  int head = 0;
+  int tail = 0;
+  queue[tail++] = i;
+  
+  while (head < tail) {
+    int c = queue[head++];
+    for (int k=0;k<8;k++) {
+      int n = c + field->neighbors[k];
+      t = field->tiles[n];
+      if (IS_FLAG(t) || IS_RVLD(t)) continue;
+      reveal_tile(field, n);
+      if (IS_EMPTY(t)) queue[tail++] = n;
+      }
+    }
+  
+  return false;
+  }
+
+bool dig(MineField *field, int x, int y) {
+  if (!IN_FIELD(x, y, field)) return false;
+  PROFILE_SCOPE(PROFILE_DIG);
+  return dig_tile(field, TILE_INDEX(field, x, y));
+  }
+
+// flags stay, mines get flagged if asked, everything else reads as revealed, see shown_tile
+void show_all(MineField *field, bool flagmines) {
+  field->all_dirty = true;
+  field->shown = flagmines ? SHOW_FLAGS : SHOW_MINES;
+  }
+
+// returns true if a mine has been reached
+bool run_chord(MineField *field, int hovered_tile_x, int hovered_tile_y) {
+  uint8_t flags = 0;
+  bool m = false;
+  
+  if (!IN_FIELD(hovered_tile_x, hovered_tile_y, field)) return m;
+  PROFILE_SCOPE(PROFILE_CHORD);
+  
+  int i = TILE_INDEX(field, hovered_tile_x, hovered_tile_y);
+  Tile t = tile_of(field, i);
+  if (!IS_RVLD(t)) return m;
+  
+  for (int k=0;k<8;k++) {
+    if (has_flag(field, i + field->neighbors[k])) flags ++;
+    }
+  
+  if (flags != TILE_GET_NUMBER(t)) return m;
+  for (int k=0;k<8;k++) {
+    int n = i + field->neighbors[k];
+    if (has_flag(field, n)) continue;
+    
+    bool a = dig_tile(field, n);
+    m = m | a;
+    }
+  
+  return m;
+  }
+
+void flip_flag(MineField *field, int x, int y) {
+  if (!IN_FIELD(x, y, field)) return;
+  int i = TILE_INDEX(field, x, y);
+  mark_dirty(field, i);
+  record_change(field, i, CHANGE_FLAG);
+  
+  bool flagged;
+  if (field->packed) {
+    field->flag_bits[i >> 6] ^= 1ull << (i & 63);
+    flagged = BIT_GET(field->flag_bits, i);
+    }
+  else {
+    touch_region(field, i);
+    field->tiles[i] ^= TILE_FLAG;
+    flagged = IS_FLAG(field->tiles[i]);
+    }
+  int change = flagged ? 1 : -1;
+  field->placed_flags += change;
+  if (field->packed ? BIT_GET(field->mine_bits, i) : IS_MINE(field->tiles[i])) field->correct_flags += change;
+  }
+
+// the counters a move changes, in the order the history keeps their changes in
+static int *move_counter(MineField *field, int k) {
+  int *counters[4] = {&field->tiles_unopened, &field->bbbv_left, &field->placed_flags, &field->correct_flags};
+  return counters[k];
+  }
+
+// starts recording a game action on a field that is being played
+static void begin_move(MineField *field) {
+  History *history = field->history;
+  if (!history || field->stride * (field->height + 2) > HISTORY_MAX_TILES) return;
+  history->end = history->cursor; // the moves that were undone cannot be redone after this one
+  history->move = history->end;
+  history->overflow = false;
+  for (int k=0;k<4;k++) history->before[k] = *move_counter(field, k);
+  history->state_before = field->state;
+  history->shown_before = field->shown;
+  push_word(history, 0); // the length, once it is known
+  }
+
+// closes the move being recorded, one that changed nothing is dropped, one that did not fit drops the whole history
+static void end_move(MineField *field) {
+  History *history = field->history;
+  if (!history || history->move < 0) return;
+  long long move = history->move;
+  int n_changes = history->end - move - 1;
+  bool changed = n_changes > 0;
+  
+  uint32_t states = history->state_before | field->state << 2 | history->shown_before << 4 | field->shown << 6;
+  for (int k=0;k<4;k++) {
+    int change = *move_counter(field, k) - history->before[k];
+    changed |= change != 0;
+    push_word(history, change);
+    }
+  push_word(history, states);
+  push_word(history, n_changes);
+  history->move = -1;
+  
+  if (history->overflow) clear_history(history);
+  else if (!changed) history->end = move;
+  else {
+    history->words[move & history->mask] = n_changes;
+    history->cursor = history->end;
+    }
+  }
+
+static void apply_change(MineField *field, uint32_t change, bool undo) {
+  int i = change >> 2;
+  switch (change & 3) {
+    case CHANGE_REVEAL:
+      if (field->packed) {
+        if (undo) BIT_CLEAR(field->rvld_bits, i);
+        else BIT_SET(field->rvld_bits, i);
+        }
+      else if (undo) field->tiles[i] &= ~TILE_RVLD;
+      else field->tiles[i] |= TILE_RVLD;
+      mark_dirty(field, i);
+      break;
+    case CHANGE_FLAG:
+      if (field->packed) field->flag_bits[i >> 6] ^= 1ull << (i & 63);
+      else field->tiles[i] ^= TILE_FLAG;
+      mark_dirty(field, i);
+      break;
+    case CHANGE_OPEN:
+      field->region_state[i] = undo ? REGION_FRESH : REGION_OPEN;
+      field->all_dirty = true;
+      break;
+    case CHANGE_TOUCH:
+      field->region_state[i] = undo ? REGION_FRESH : REGION_TOUCHED;
+      break;
+    }
+  }
+
+// applies the move that starts at position p in the history, or takes it back, returns the other end of it
+static long long apply_move(MineField *field, long long p, bool undo) {
+  History *history = field->history;
+  uint32_t *words = history->words;
+  int mask = history->mask;
+  long long start = undo ? p - (words[(p-1) & mask] + MOVE_WORDS) : p;
+  int n_changes = words[start & mask];
+  
+  if (undo) {
+    for (long long q=start+n_changes;q>start;q--) apply_change(field, words[q & mask], true);
+    }
+  else {
+    for (long long q=start+1;q<=start+n_changes;q++) apply_change(field, words[q & mask], false);
+    }
+  
+  int sign = undo ? -1 : 1;
+  for (int k=0;k<4;k++) *move_counter(field, k) += sign * (int) words[(start+n_changes+1+k) & mask];
+  uint32_t states = words[(start+n_changes+5) & mask];
+  int state = undo ? states & 3 : (states >> 2) & 3;
+  int shown = undo ? (states >> 4) & 3 : (states >> 6) & 3;
+  if (state != field->state || shown != field->shown) field->all_dirty = true;
+  field->state = state;
+  field->shown = shown;
+  return undo ? start : start + n_changes + MOVE_WORDS;
+  }
+
+History *create_history(int max_words) {
+  int capacity = MOVE_WORDS + 1;
+  while (capacity < max_words) capacity *= 2;
+  
+  History *history = malloc(sizeof(History));
+  uint32_t *words = malloc(sizeof(uint32_t) * capacity);
+  if (!history || !words) {
+    free(history);
+    free(words);
+    return NULL;
+    }
+  history->words = words;
+  history->mask = capacity - 1;
+  history->end = 0;
+  clear_history(history);
+  return history;
+  }
+
+void destroy_history(History *history) {
+  free(history->words);
+  free(history);
+  }
+
+void clear_history(History *history) {
+  history->first = history->end;
+  history->cursor = history->end;
+  history->move = -1;
+  history->overflow = false;
+  }
+
+bool field_undo(MineField *field) {
+  History *history = field->history;
+  if (!history || field->state == GAME_WAITING || history->cursor == history->first) return false;
+  history->cursor = apply_move(field, history->cursor, true);
+  return true;
+  }
+
+bool field_redo(MineField *field) {
+  History *history = field->history;
+  if (!history || field->state == GAME_WAITING || history->cursor == history->end) return false;
+  history->cursor = apply_move(field, history->cursor, false);
+  return true;
+  }
+
+// the counters are exact, so a game is won as soon as only the mines are left covered
+static void check_won(MineField *field) {
+  if (field->state != GAME_PLAYING) return;
+  if (field->tiles_unopened != field->placed_mines) return;
+  field->state = GAME_WON;
+  field->events |= FIELD_EVENT_WON;
+  show_all(field, true);
+  }
+
+static void lose(MineField *field) {
+  field->state = GAME_OVER;
+  field->events |= FIELD_EVENT_LOST;
+  show_all(field, false);
+  }
+
+// ends a game action, in practice mode one that hit a mine is taken back unless the history could not hold it
+static void finish_action(MineField *field, bool mine) {
+  History *history = field->history;
+  if (mine && field->practice && history && history->move >= 0) {
+    end_move(field);
+    if (history->cursor > history->first) {
+      history->cursor = apply_move(field, history->cursor, true);
+      history->end = history->cursor; // the mine cannot be redone
+      field->rewinds ++;
+      field->events |= FIELD_EVENT_REWOUND;
+      return;
+      }
+    }
+  
+  if (mine) lose(field);
+  else check_won(field);
+  end_move(field);
+  }
+
+int field_open(MineField *field, int x, int y) {
+  if (!IN_FIELD(x, y, field)) return field->state;
+  
+  if (field->state == GAME_WAITING) {
+    if (!field->generated && !generate_field(field, field->n_mines, x, y)) return field->state;
+    field->state = GAME_PLAYING;
+    field->events |= FIELD_EVENT_STARTED;
+    // the opening made the board, the history starts after it
+    if (field->history) clear_history(field->history);
+    field->rewinds = 0;
+    }
+  else if (field->state != GAME_PLAYING) return field->state;
+  else begin_move(field);
+  
+  finish_action(field, dig(field, x, y));
+  return field->state;
+  }
+
+int field_chord(MineField *field, int x, int y) {
+  if (field->state != GAME_PLAYING) return field->state;
+  
+  begin_move(field);
+  finish_action(field, run_chord(field, x, y));
+  return field->state;
+  }
+
+int field_flag(MineField *field, int x, int y) {
+  if (field->state != GAME_PLAYING) return field->state;
+  if (!IN_FIELD(x, y, field)) return field->state;
+  
+  if (IS_RVLD(get_tile(field, x, y))) return field->state;
+  begin_move(field);
+  flip_flag(field, x, y);
+  end_move(field);
+  field->events |= FIELD_EVENT_FLAGS;
+  return field->state;
+  }
+
+int field_state(MineField *field) {
+  return field->state;
+  }
+
+int field_mines_left(MineField *field) {
+  if (field->state == GAME_WAITING) return field->n_mines;
+  if (field->state == GAME_WON) return 0;
+  return field->placed_mines - field->placed_flags;
+  }
+
+int field_events(MineField *field) {
+  int events = field->events;
+  field->events = 0;
+  return events;
+  }
@@ -0,0 +1,262 @@
+/*
+  The minesweeper engine: board generation and the rules of the game.
+  Has no SDL dependency, the SDL front end in mines.c is a client of it.
+  
+  Typical use:
+    MineField *field = create_field(16, 16, 40);
+    field_open(field, x, y);  // the first open generates the board around (x, y)
+    field_flag(field, x, y);
+    field_chord(field, x, y);
+    if (field_state(field) == GAME_WON) ...
+    destroy_field(field);
+  
+  create_packed_field() makes a field that keeps the mine, revealed and flag state as bit
+  planes and derives numbers when a tile is read, 3 bits per tile instead of the about 16 bytes
+  a byte field takes with its dig queue, 3BV planes and region index (see field_memory()).
+  The same functions work on it, except for no guess generation and the solver, which need
+  the byte layout. Its boards differ from those of create_field() for the same seed.
+  
+  The empty regions of a byte field are labeled when its board is generated. A click on a large
+  one that no flag or click touched yet marks it open and reveals only the numbers around it,
+  its empty tiles read as revealed through field_tile() and get_tile(), the counters stay exact.
+  
+  create_field_in() places a byte field in an arena (arena.h) together with everything it
+  will ever need, field_memory() bytes, so starting and playing games on it never allocates.
+  
+  The counters in MineField are kept up to date by every operation, nothing scans the board
+  to find out how a game stands. The game functions also record what happened as FIELD_EVENT_*
+  bits, which field_events() hands out once. When a game ends the board is not rewritten,
+  get_tile() shows every tile as revealed from then on.
+  
+  A History attached to a field records what each game action after the opening changed, one
+  word per tile and a few per action, so field_undo() and field_redo() cost as much as the action
+  did. With field->practice set, an action that hits a mine is taken back instead of ending the game.
+  A field of more than HISTORY_MAX_TILES padded tiles records nothing and cannot undo.
+    field->history = create_history(HISTORY_WORDS);
+    field_undo(field);
+*/
+
+#ifndef MINEFIELD_H
+#define MINEFIELD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "arena.h"
+
+// Tile
+#define Tile uint8_t
+
+#define RIGHT_MASK 15 // 0000 1111
+
+#define TILE0       0 // 0000 0000
+#define TILE1       1 // 0000 0001
+#define TILE2       2 // 0000 0010
+#define TILE3       3 // 0000 0011
+#define TILE4       4 // 0000 0100
+#define TILE5       5 // 0000 0101
+#define TILE6       6 // 0000 0110
+#define TILE7       7 // 0000 0111
+#define TILE8       8 // 0000 1000
+#define TILE_INVA  10 // 0000 1010 invalid tile
+#define TILE_FLAG  16 // XXX1 XXXX
+#define TILE_MINE  32 // XX1X XXXX
+#define TILE_RVLD  64 // X1XX XXXX 1 if the tile is revealed
+#define TILE_WFLG 128 // 1XXX XXXX 1 if the tile is dented
+
+#define IS_MINE(x) (x & TILE_MINE)
+#define IS_FLAG(x) (x & TILE_FLAG)
+#define IS_RVLD(x) (x & TILE_RVLD)
+#define IS_WFLG(x) (x & TILE_WFLG)
+#define IS_INVA(x) (x & TILE_INVA)
+#define TILE_GET_NUMBER(x) (x & RIGHT_MASK)
+#define IS_EMPTY(x) ((x & RIGHT_MASK) == 0)
+
+#define IN_FIELD(x, y, field) !(x < 0 || x >= field->width || y < 0 || y >= field->height)
+
+// tiles are stored row-major with a one tile border around the field, the border tiles
+// are revealed numbers that are never mines or flags, so neighbor lookups need no bounds checks
+#define TILE_BORDER (TILE_INVA | TILE_RVLD)
+#define TILE_INDEX(field, x, y) (((y)+1) * (field)->stride + (x)+1)
+#define TILE_AT(field, x, y) ((field)->tiles[TILE_INDEX(field, x, y)])
+
+#define DIRTY_MAX 1024 // changed tiles tracked one by one before the whole field is redrawn
+
+#define GAME_PLAYING 0
+#define GAME_OVER    1
+#define GAME_WON     2
+#define GAME_WAITING 3
+
+// field->events
+#define FIELD_EVENT_STARTED 1 // the first open generated the board
+#define FIELD_EVENT_FLAGS   2 // a flag was placed or removed
+#define FIELD_EVENT_LOST    4
+#define FIELD_EVENT_WON     8
+#define FIELD_EVENT_REWOUND 16 // practice mode took back an action that hit a mine
+
+// field->shown, how get_tile reads the board once the game is over
+#define SHOW_NONE  0
+#define SHOW_MINES 1 // tiles without a flag read as revealed, flags on safe tiles as TILE_WFLG
+#define SHOW_FLAGS 2 // the same, except that mines read as flagged
+
+#define NO_GUESS_BUDGET_MS 1000 // default time allowed to find a board that needs no guessing
+
+#define PACKED_QUEUE_MIN 1024 // starting dig queue of a packed field, a power of two
+
+// native builds load the planes of a packed field from a snapshot by mapping the file, see snapshot.h
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define FIELD_MMAP
+#endif
+
+// field->region_state
+#define REGION_FRESH   0 // no tile of it was flagged or revealed yet
+#define REGION_OPEN    1 // opened as a whole, its empty tiles read as revealed
+#define REGION_TOUCHED 2 // has to be flooded tile by tile
+
+// history changes, the low 2 bits of a word, the rest is a padded tile index or a region
+#define CHANGE_REVEAL 0 // the tile was revealed
+#define CHANGE_FLAG   1 // its flag was flipped
+#define CHANGE_OPEN   2 // the region was opened as a whole
+#define CHANGE_TOUCH  3 // the region was touched
+#define MOVE_WORDS    7 // per move besides its changes: its length twice, 4 counter changes, the states
+
+#define HISTORY_WORDS (1 << 20) // a default history, 4 MB
+#define HISTORY_MAX_TILES (1 << 30) // padded tiles of the largest field a history records, the index gets 30 bits
+
+extern const int offsets3x3[];
+
+// xoshiro128** generator, every field owns one so boards are reproducible from their seed
+typedef struct {
+  uint32_t s[4];
+  } Rng;
+
+void rng_seed(Rng *rng, uint64_t seed);
+uint32_t rng_next(Rng *rng);
+uint32_t rng_range(Rng *rng, uint32_t n); // uniform in [0, n)
+
+// a ring buffer of moves, each one is its length, its changes, how it changed the counters and the
+// game state, and its length again, so it can be walked both ways. Positions count words since the
+// history was cleared, word p is words[p & mask]. The oldest moves are dropped to make room
+typedef struct {
+  uint32_t *words;
+  int mask; // the capacity, a power of two, minus one
+  long long first; // start of the oldest move
+  long long cursor; // end of the last move that was not undone
+  long long end; // end of the moves that can be redone
+  long long move; // start of the move being recorded, -1 between moves
+  bool overflow; // the move being recorded does not fit, it is dropped with the rest
+  int before[4]; // the counters when the move started
+  int state_before;
+  int shown_before;
+  } History;
+
+typedef struct {
+  int width;
+  int height;
+  int stride; // width + 2, the length of a padded row
+  int n_mines; // requested number of mines
+  int placed_mines;
+  int placed_flags;
+  int correct_flags; // flags on mines
+  int tiles_unopened;
+  int bbbv; // 3BV: openings plus numbers that no opening reveals, the clicks the board needs
+  int bbbv_left; // of those, the ones not revealed yet
+  int state;
+  int events; // FIELD_EVENT_* since the last field_events
+  int shown; // SHOW_*
+  bool generated;
+  uint64_t seed; // the board generated by the next field_open depends only on this and the opening
+  Rng rng;
+  
+  bool no_guess; // regenerate until the solver can clear the board from the opening
+  int no_guess_budget_ms;
+  int no_guess_attempts; // boards the last no guess generation tried
+  int no_guess_fixed_attempts; // if set, try this many boards instead of watching the clock, for replays
+  bool guess_free; // the solver cleared the current board
+  
+  History *history; // owned by the caller, records the game actions when set
+  bool practice; // take back actions that hit a mine, needs a history
+  int rewinds; // actions practice mode took back this game
+  
+  int neighbors[8]; // index offsets of the 8 neighbors of a tile
+  Tile *tiles; // NULL in a packed field
+  int *queue; // work list for dig, one slot per tile
+  uint64_t *scratch; // bit planes for counting 3BV, kept for the next board
+  
+  // the connected regions of empty tiles of a byte field, labeled when a board is generated,
+  // so a click on a large one marks it open instead of revealing every tile
+  int n_regions; // 0 while there is no board or it could not be labeled
+  int *region_of; // per tile, the region of an empty tile
+  int *region_start; // region r is bordered by the numbers region_border[region_start[r]] up to region_start[r+1]
+  int *region_border;
+  int *region_zeros; // empty tiles per region
+  uint8_t *region_state; // REGION_*
+  bool in_arena; // made by create_field_in, destroy_field leaves it to the arena
+  
+  // packed fields, one bit per padded tile index in each plane, border tiles are revealed
+  bool packed;
+  uint64_t *mine_bits;
+  uint64_t *rvld_bits;
+  uint64_t *flag_bits;
+  int n_words; // per plane
+  int queue_capacity; // the dig queue is a ring buffer that grows with the flood frontier
+  void *mapping; // the snapshot file the planes are mapped from, if they are, destroy_field unmaps it
+  size_t mapping_size;
+  
+  // tiles changed since the last frame
+  int dirty[DIRTY_MAX];
+  int dirty_len;
+  bool all_dirty;
+  } MineField;
+
+// a tile of a byte field by index, the empty tiles inside an opened region read as revealed,
+// the tiles next to a number are always up to date in field->tiles
+static inline Tile field_tile(const MineField *field, int i) {
+  Tile t = field->tiles[i];
+  if (!IS_RVLD(t) && IS_EMPTY(t) && field->n_regions && field->region_state[field->region_of[i]] == REGION_OPEN) t |= TILE_RVLD;
+  return t;
+  }
+
+// board
+MineField *create_field(int width, int height, int n_mines); // NULL if the size does not fit or memory ran out
+MineField *create_packed_field(int width, int height, int n_mines); // likewise
+bool field_size_fits(int width, int height); // the padded tiles, rounded up to whole plane words, can be indexed with an int
+size_t field_memory(int width, int height); // what create_field_in takes from an arena
+MineField *create_field_in(Arena *arena, int width, int height, int n_mines); // NULL if it does not fit
+void destroy_field(MineField *field);
+void set_field_seed(MineField *field, uint64_t seed);
+bool generate_field(MineField *field, int n_mines, int opening_x, int opening_y); // false without memory, the field is then not generated
+bool check_mine_counts(MineField *field); // the numbers of a byte field match a per tile count, for bench --check
+void clear_field(MineField *field);
+
+// tiles
+Tile get_tile(MineField *field, int x, int y);
+uint8_t check(MineField *field, int x, int y);
+uint8_t reveal(MineField *field, int x, int y);
+void mark_dirty(MineField *field, int i);
+int count_tiles(MineField *field, Tile bit); // tiles with TILE_MINE, TILE_FLAG or TILE_RVLD set
+bool field_cleared(MineField *field); // every tile that is not a mine is revealed
+
+// raw operations, these do not change the game state
+bool dig(MineField *field, int x, int y);
+bool dig_tile(MineField *field, int i);
+bool run_chord(MineField *field, int hovered_tile_x, int hovered_tile_y);
+void flip_flag(MineField *field, int x, int y);
+void show_all(MineField *field, bool flagmines); // sets field->shown, the tiles stay as they are
+
+// game, these return the game state after the action
+int field_open(MineField *field, int x, int y);
+int field_chord(MineField *field, int x, int y);
+int field_flag(MineField *field, int x, int y);
+int field_state(MineField *field);
+int field_mines_left(MineField *field);
+int field_events(MineField *field); // the events since the last call
+
+// history, max_words is rounded up to a power of two
+History *create_history(int max_words); // NULL without memory
+void destroy_history(History *history);
+void clear_history(History *history);
+bool field_undo(MineField *field); // false if there is nothing to take back
+bool field_redo(MineField *field);
+
+#endif
@@ -4,15 +4,27 @@
   Features:
     - usual minesweeper things (open tile, set flag, ...)
     - chording (with the middle mouse button) see https://en.wikipedia.org/wiki/Chording section 'Minesweeper tactic'
+    - reproducible boards, start with --seed N, press S to print and copy the current seed
+    - no guess mode, start with --no-guess or press N
+    - board size presets (--preset NAME or keys 1, 2, 3) and custom sizes (--width, --height, --mines, --density)
+    - boards larger than the screen scroll: drag with space held or use the arrow keys, zoom with the mouse wheel
+    - endless mode without edges, start with --endless or press E
+    - games are recorded with --record FILE and played back with --replay FILE, hold Tab to fast-forward
+    - press O to tint the covered tiles next to numbers by their exact chance of holding a mine
+    - Z takes back a move and Y plays it again, practice mode (--practice or R) takes back clicks on mines
+    - an unfinished game is saved and continues on the next start
+    - --latency prints percentiles of the time from a click or key press to the frame that shows it
 */
 
 // source emsdk/emsdk_env.sh
-// emcc mines.c -O3 --shell-file shell.html --preload-file res -sUSE_SDL=2 -sUSE_SDL_IMAGE=2 -sSDL2_IMAGE_FORMATS='["png"]' -o web/web.html
+// emcc mines.c minefield.c solver.c endless.c replay.c odds.c snapshot.c -O3 --shell-file shell.html --preload-file res -sUSE_SDL=2 -sUSE_SDL_IMAGE=2 -sSDL2_IMAGE_FORMATS='["png"]' -lidbfs.js -o web/web.html
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
 #include <stdbool.h>
+#include <string.h>
+#include <limits.h>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
@@ -21,6 +33,49 @@
 #include <emscripten.h>
 #endif
 
+#include "minefield.h"
+#include "solver.h"
+#include "endless.h"
+#include "replay.h"
+#include "odds.h"
+#include "snapshot.h"
+#include "profile.h"
+
+#define PADDING 8
+
+#define IMG_TILE_MINE    9
+#define IMG_TILE_FLAG    10
+#define IMG_TILE_UNKNOWN 11
+#define IMG_TILE_INSET   12
+#define IMG_TILE_OPENED  13
+
+#define IMG_BIG_FLAG     14
+#define IMG_BIG_MINE     15
+#define IMG_BIG_RETRY    16
+#define IMG_BIG_WON      17
+#define IMG_TILE_WFLG    18
+
+#define IMG_DIGITS_START 19
+#define IMG_DIGIT_EMPTY  29
+#define IMG_DIGIT_MINUS  30
+#define IMG_COUNT        31
+
+// all sprites are packed into one texture so that consecutive draws never switch textures
+typedef struct {
+  SDL_Texture *texture;
+  int w;
+  int h;
+  SDL_Rect sprites[IMG_COUNT];
+  } Atlas;
+
+#define BATCH_MAX 16384 // sprites per SDL_RenderGeometry call
+
+typedef struct {
+  SDL_Vertex vertices[BATCH_MAX*4];
+  int indices[BATCH_MAX*6];
+  int len;
+  } SpriteBatch;
+
 int count_set_bits(int n) {
   int c = 0;
   while (n) {
@@ -36,13 +91,54 @@ int count_digits(int n) {
   return c;
   }
 
-void draw_texture(SDL_Renderer *renderer, SDL_Texture *texture, int x, int y) {
-  int w, h;
-  SDL_QueryTexture(texture, NULL, NULL, &w, &h);
-  SDL_RenderCopy(renderer, texture, NULL, &(SDL_Rect) {x, y, w, h});
+void draw_texture(SDL_Renderer *renderer, Atlas *atlas, int image, int x, int y) {
+  SDL_Rect *src = &atlas->sprites[image];
+  SDL_RenderCopy(renderer, atlas->texture, src, &(SDL_Rect) {x, y, src->w, src->h});
+  PROFILE_COUNT(PROFILE_DRAW_CALLS, 1);
   }
 
-void draw_rigid_rect(SDL_Renderer *renderer, SDL_Texture *texture, int x, int y, int w, int h) {
+// queues a sprite drawn at scale times its size
+void batch_texture(SpriteBatch *batch, Atlas *atlas, int image, float x, float y, float scale) {
+  SDL_Rect *src = &atlas->sprites[image];
+  SDL_Vertex *v = &batch->vertices[batch->len*4];
+  float w = src->w * scale;
+  float h = src->h * scale;
+  
+  float u0 = (float) src->x / atlas->w;
+  float v0 = (float) src->y / atlas->h;
+  float u1 = (float) (src->x + src->w) / atlas->w;
+  float v1 = (float) (src->y + src->h) / atlas->h;
+  SDL_Color white = {255, 255, 255, 255};
+  
+  v[0] = (SDL_Vertex) {{x, y}, white, {u0, v0}};
+  v[1] = (SDL_Vertex) {{x+w, y}, white, {u1, v0}};
+  v[2] = (SDL_Vertex) {{x+w, y+h}, white, {u1, v1}};
+  v[3] = (SDL_Vertex) {{x, y+h}, white, {u0, v1}};
+  batch->len ++;
+  }
+
+void flush_batch(SDL_Renderer *renderer, SpriteBatch *batch, Atlas *atlas) {
+  if (batch->len == 0) return;
+  SDL_RenderGeometry(renderer, atlas->texture, batch->vertices, batch->len*4, batch->indices, batch->len*6);
+  PROFILE_COUNT(PROFILE_DRAW_CALLS, 1);
+  batch->len = 0;
+  }
+
+SpriteBatch *create_batch(Arena *arena) {
+  SpriteBatch *batch = arena_alloc(arena, sizeof(SpriteBatch));
+  batch->len = 0;
+  for (int i=0;i<BATCH_MAX;i++) {
+    int *q = &batch->indices[i*6];
+    q[0] = i*4; q[1] = i*4+1; q[2] = i*4+2;
+    q[3] = i*4; q[4] = i*4+2; q[5] = i*4+3;
+    }
+  return batch;
+  }
+
+void draw_rigid_rect(SDL_Renderer *renderer, Atlas *atlas, int image, int x, int y, int w, int h) {
+  SDL_Texture *texture = atlas->texture;
+  SDL_Rect *src = &atlas->sprites[image];
+  
   SDL_SetRenderDrawColor(renderer, 165, 165, 165, 255);
   SDL_RenderFillRect(renderer, &(SDL_Rect) {x, y, w, h});
   
@@ -58,13 +154,17 @@ void draw_rigid_rect(SDL_Renderer *renderer, SDL_Texture *texture, int x, int y,
   SDL_SetRenderDrawColor(renderer, 127, 127, 127, 255);
   SDL_RenderFillRect(renderer, &(SDL_Rect) {x+w-3, y, 3, h});
   
-  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {0, 0, 3, 3}, &(SDL_Rect) {x, y, 3, 3});
-  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {19, 0, 3, 3}, &(SDL_Rect) {x+w-3, y, 3, 3});
-  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {19, 19, 3, 3}, &(SDL_Rect) {x+w-3, y+h-3, 3, 3});
-  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {0, 19, 3, 3}, &(SDL_Rect) {x, y+h-3, 3, 3});
+  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {src->x, src->y, 3, 3}, &(SDL_Rect) {x, y, 3, 3});
+  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {src->x+19, src->y, 3, 3}, &(SDL_Rect) {x+w-3, y, 3, 3});
+  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {src->x+19, src->y+19, 3, 3}, &(SDL_Rect) {x+w-3, y+h-3, 3, 3});
+  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {src->x, src->y+19, 3, 3}, &(SDL_Rect) {x, y+h-3, 3, 3});
+  PROFILE_COUNT(PROFILE_DRAW_CALLS, 9);
   }
 
-void draw_inset_rect(SDL_Renderer *renderer, SDL_Texture *texture, int x, int y, int w, int h) {
+void draw_inset_rect(SDL_Renderer *renderer, Atlas *atlas, int image, int x, int y, int w, int h) {
+  SDL_Texture *texture = atlas->texture;
+  SDL_Rect *src = &atlas->sprites[image];
+  
   SDL_SetRenderDrawColor(renderer, 165, 165, 165, 255);
   SDL_RenderFillRect(renderer, &(SDL_Rect) {x, y, w, h});
   
@@ -80,39 +180,39 @@ void draw_inset_rect(SDL_Renderer *renderer, SDL_Texture *texture, int x, int y,
   SDL_SetRenderDrawColor(renderer, 207, 207, 207, 255);
   SDL_RenderFillRect(renderer, &(SDL_Rect) {x+w-3, y, 3, h});
   
-  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {0, 0, 3, 3}, &(SDL_Rect) {x, y, 3, 3});
-  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {19, 0, 3, 3}, &(SDL_Rect) {x+w-3, y, 3, 3});
-  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {19, 19, 3, 3}, &(SDL_Rect) {x+w-3, y+h-3, 3, 3});
-  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {0, 19, 3, 3}, &(SDL_Rect) {x, y+h-3, 3, 3});
+  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {src->x, src->y, 3, 3}, &(SDL_Rect) {x, y, 3, 3});
+  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {src->x+19, src->y, 3, 3}, &(SDL_Rect) {x+w-3, y, 3, 3});
+  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {src->x+19, src->y+19, 3, 3}, &(SDL_Rect) {x+w-3, y+h-3, 3, 3});
+  SDL_RenderCopy(renderer, texture, &(SDL_Rect) {src->x, src->y+19, 3, 3}, &(SDL_Rect) {x, y+h-3, 3, 3});
+  PROFILE_COUNT(PROFILE_DRAW_CALLS, 9);
   }
 
-#define PADDING 8
-
-#define IMG_TILE_FLAG    10
-#define IMG_TILE_UNKNOWN 11
-#define IMG_TILE_INSET   12
-#define IMG_TILE_OPENED  13
-
-#define IMG_BIG_FLAG     14
-#define IMG_BIG_MINE     15
-#define IMG_BIG_RETRY    16
-#define IMG_BIG_WON      17
-#define IMG_TILE_WFLG    18
-
-#define IMG_DIGITS_START 19
-#define IMG_DIGIT_EMPTY  29
-#define IMG_DIGIT_MINUS  30
-
-#define GAME_PLAYING 0
-#define GAME_OVER    1
-#define GAME_WON     2
-#define GAME_WAITING 3
-
 #define WIDGET_BIG_BUTTON 0
 #define WIDGET_MINE_DISPLAY 1
+#define N_WIDGETS 2
 
 #define STARTING_FIELD_WIDTH 16
 #define STARTING_FIELD_HEIGHT 16
+#define STARTING_DENSITY (1.0/6) // mines per tile when no mine count is given
+
+#define MIN_FIELD_WIDTH 9 // narrower fields leave no room for the top bar
+#define MAX_FIELD_SIZE 10000
+#define PACKED_FIELD_TILES (2048*2048) // fields this large use the bit plane layout
+
+typedef struct {
+  const char *name;
+  int width;
+  int height;
+  int n_mines;
+  } Preset;
+
+const Preset presets[] = {
+  {"beginner", 9, 9, 10},
+  {"intermediate", 16, 16, 40},
+  {"expert", 30, 16, 99},
+  };
+
+#define N_PRESETS 3
 
 // Button
 typedef struct {
@@ -132,36 +232,37 @@ typedef struct {
 #define BUTTON_IS_HOVERED(b) (b->state & BUTTON_HOVERED)
 #define BUTTON_IS_PUSHED(b)  (b->state & BUTTON_PUSHED)
 
-void draw_button(SDL_Renderer *renderer, Button *button, SDL_Texture **textures) {
+void draw_button(SDL_Renderer *renderer, Button *button, Atlas *atlas) {
   int offset_x = 3;
   int offset_y = 3;
   if (BUTTON_IS_PUSHED(button)) {
-    draw_inset_rect(renderer, textures[12], button->x, button->y, button->w, button->h);
+    draw_inset_rect(renderer, atlas, IMG_TILE_INSET, button->x, button->y, button->w, button->h);
     offset_x ++;
     offset_y ++;
     }
   else {
-    draw_rigid_rect(renderer, textures[11], button->x, button->y, button->w, button->h);
+    draw_rigid_rect(renderer, atlas, IMG_TILE_UNKNOWN, button->x, button->y, button->w, button->h);
     }
-  draw_texture(renderer, textures[button->image], button->x+offset_x, button->y+offset_y);
+  draw_texture(renderer, atlas, button->image, button->x+offset_x, button->y+offset_y);
   }
 
-void update_button(Button *button, uint32_t mouse_just_clicked) {
-  int mouse_x, mouse_y;
-  uint32_t button_state = SDL_GetMouseState(&mouse_x, &mouse_y);
-  
-  if ((mouse_x >= button->x && mouse_x <= button->x+button->w)
-   && (mouse_y >= button->y && mouse_y <= button->y+button->h)) button->state |= BUTTON_HOVERED;
+bool button_contains(const Button *button, int x, int y) {
+  return (x >= button->x && x <= button->x+button->w)
+      && (y >= button->y && y <= button->y+button->h);
+  }
+
+// mouse_x, mouse_y and mouse_buttons are the pointer as of the last event handled,
+// left_release is where the left button was let go since the last update, NULL if it was not
+void update_button(Button *button, int mouse_x, int mouse_y, uint32_t mouse_buttons, const SDL_Point *left_release) {
+  if (button_contains(button, mouse_x, mouse_y)) button->state |= BUTTON_HOVERED;
   else button->state &= ~BUTTON_HOVERED;
   
-  if (button_state & SDL_BUTTON(SDL_BUTTON_LEFT)
+  if (mouse_buttons & SDL_BUTTON_LMASK
                    && BUTTON_IS_HOVERED(button)) button->state |= BUTTON_PUSHED;
   else button->state &= ~BUTTON_PUSHED;
   
   if (BUTTON_IS_CLICKED(button)) button->state &= ~BUTTON_CLICKED;
-  if (BUTTON_IS_HOVERED(button)) {
-    if (mouse_just_clicked & SDL_BUTTON_LEFT) button->state |= BUTTON_CLICKED;
-    }
+  if (left_release && button_contains(button, left_release->x, left_release->y)) button->state |= BUTTON_CLICKED;
   
   }
 
@@ -173,13 +274,14 @@ typedef struct {
   int value;
   } NumberDisplay;
 
-void draw_number_display(SDL_Renderer *renderer, NumberDisplay *display, SDL_Texture **textures) {
+void draw_number_display(SDL_Renderer *renderer, NumberDisplay *display, Atlas *atlas) {
   int w = 23*display->digits+4;
   int h = 44;
-  draw_inset_rect(renderer, textures[12], display->x, display->y, w, h);
+  draw_inset_rect(renderer, atlas, IMG_TILE_INSET, display->x, display->y, w, h);
   
   SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
   SDL_RenderFillRect(renderer, &(SDL_Rect) {display->x+3, display->y+3, w-6, h-6});
+  PROFILE_COUNT(PROFILE_DRAW_CALLS, 1);
   
   int n = abs(display->value);
   bool minus_drawn = false;
@@ -187,355 +289,1011 @@ void draw_number_display(SDL_Renderer *renderer, NumberDisplay *display, SDL_Tex
     int a = display->digits - i-1;
     int digit_x = display->x + ((a*22)+5);
     
-    draw_texture(renderer, textures[IMG_DIGIT_EMPTY], digit_x, display->y+5);
+    draw_texture(renderer, atlas, IMG_DIGIT_EMPTY, digit_x, display->y+5);
     if (n > 0 || i == 0) {
-      draw_texture(renderer, textures[IMG_DIGITS_START+n%10], digit_x, display->y+5);
+      draw_texture(renderer, atlas, IMG_DIGITS_START+n%10, digit_x, display->y+5);
       }
     else {
       if (display->value < 0 && !minus_drawn) {
         minus_drawn = true;
-        draw_texture(renderer, textures[IMG_DIGIT_MINUS], digit_x, display->y+5);
+        draw_texture(renderer, atlas, IMG_DIGIT_MINUS, digit_x, display->y+5);
         }
       }
     n /= 10;
     }
   }
 
-// Tile
-#define Tile uint8_t
+#define TILE_SIZE 22
+#define TOPBAR_HEIGHT 72
 
-#define RIGHT_MASK 15 // 0000 1111
+#define MIN_ZOOM 0.25f
+#define MAX_ZOOM 4.0f
+#define ZOOM_STEP 1.25f
+#define PAN_STEP 4 // tiles per arrow key press
+#define WINDOW_MARGIN 64 // room left on the display for the window decorations
 
-#define TILE0       0 // 0000 0000
-#define TILE1       1 // 0000 0001
-#define TILE2       2 // 0000 0010
-#define TILE3       3 // 0000 0011
-#define TILE4       4 // 0000 0100
-#define TILE5       5 // 0000 0101
-#define TILE6       6 // 0000 0110
-#define TILE7       7 // 0000 0111
-#define TILE8       8 // 0000 1000
-#define TILE_INVA  10 // 0000 1010 invalid tile
-#define TILE_FLAG  16 // XXX1 XXXX
-#define TILE_MINE  32 // XX1X XXXX
-#define TILE_RVLD  64 // X1XX XXXX 1 if the tile is revealed
-#define TILE_WFLG 128 // 1XXX XXXX 1 if the tile is dented
+#define ENDLESS_VIEW_WIDTH 40 // tiles
+#define ENDLESS_VIEW_HEIGHT 24
+#define ENDLESS_DIGITS 6 // the display shows the opened tiles in endless mode
 
-#define IS_MINE(x) (x & TILE_MINE)
-#define IS_FLAG(x) (x & TILE_FLAG)
-#define IS_RVLD(x) (x & TILE_RVLD)
-#define IS_WFLG(x) (x & TILE_WFLG)
-#define IS_INVA(x) (x & TILE_INVA)
-#define TILE_GET_NUMBER(x) (x & RIGHT_MASK)
-#define IS_EMPTY(x) ((x & RIGHT_MASK) == 0)
+#define NO_TILE INT_MIN // hovered tile outside of the view, valid in no mode
 
-#define IN_FIELD(x, y, field) !(x < 0 || x >= field->width || y < 0 || y >= field->height)
+#define FRAME_MS 16 // minimum time between frames when the renderer has no vsync
+#define IDLE_WAIT_MS 1000 // longest sleep of the native loop while nothing happens
 
-#define TILE_SIZE 22
-#define TOPBAR_HEIGHT 72
+#define LATENCY_PENDING 64 // inputs waiting for a present, more in one frame are not measured
+#define LATENCY_MAX_MS 250 // the last bucket of the histogram counts everything slower
+#define LATENCY_REPORT 100 // measured inputs between reports, the web build never exits to report at the end
 
-const int offsets3x3[] = {-1, 0, -1, -1, 0, -1, 1, -1, 1, 0, 1, 1, 0, 1, -1, 1, 0, 0};
+#define REPLAY_END_PAUSE_MS 2000 // a finished game stays on screen this long before the next one
+#define AUTOSAVE_MS 30000 // a game in progress that changed is saved this often, and when the window closes
+#define SAVE_FILE "game.snap"
+#define REPLAY_FAST_FORWARD 8 // playback speed while Tab is held
 
-typedef struct {
-  int width;
-  int height;
-  int placed_mines;
-  int placed_flags;
-  int tiles_unopened;
-  bool generated;
-  Tile **tiles;
-  } MineField;
+#define ODDS_SHADES 11 // of the probability overlay: safe, 9 steps in between and certain mines
+#define ODDS_RECTS 256 // drawn per SDL_RenderFillRects call
 
 typedef struct {
+  Arena arena; // holds the context itself, the widgets and the sprite batch
   SDL_Window *window;
   SDL_Renderer *renderer;
   
-  SDL_Texture **textures;
-  int textures_len;
+  Atlas atlas;
+  SpriteBatch *batch;
   
   int field_screen_x;
   int field_screen_y;
   
-  int game_state;
+  // the part of the field on screen, camera_x/y is the position of its top left corner
+  // in screen pixels from the top left corner of the field at the current zoom
+  int view_w;
+  int view_h;
+  float camera_x;
+  float camera_y;
+  float zoom;
+  bool panning;
+  
+  SDL_Texture *board; // cached window background and field, NULL if render targets are unsupported
+  bool redraw_board;
+  bool redraw; // something on screen changed since the last present
+  bool vsync;
+  uint32_t last_present;
+  int mouse_x; // where the pointer was at the last event handled, a click happens where its own event says
+  int mouse_y;
+  uint32_t mouse_buttons; // held as of the last event handled
   
   void **widgets;
   int widgets_len;
   MineField *field;
+  Arena game_arena; // the field and the spare, sized for the current board, see create_board
+  MineField *spare; // an unused field of the same size for the no guess generator, NULL if there is none
+  EndlessField *endless; // the current game is endless when set, field then only keeps the seed
+  Rng seeds; // seeds of the games after the first one
+  
+  // size of the next game, the field is recreated when it differs from the current one
+  int width;
+  int height;
+  int n_mines;
+  bool endless_mode;
+  double endless_density;
+  
+  // no guess boards are generated on a worker thread after the first click
+  SDL_Thread *generator;
+  MineField *pending;
+  SDL_atomic_t pending_done;
+  uint32_t pending_event; // wakes up the main loop when the board is ready
+  int pending_x;
+  int pending_y;
+  
+  // recording and playback, see replay.h
+  FILE *record; // every game is appended to it when set
+  ReplayWriter writer;
+  bool off_record; // the rest of the game is not recorded, a playback could not follow an undo or a practice rewind
+  uint32_t game_start; // ticks of the recording are counted from here
+  bool replaying;
+  ReplayReader replay;
+  ReplayAction next_action;
+  uint32_t replay_time; // position of the playback in the current game
+  uint32_t replay_last; // when replay_time was last moved
+  bool fast_forward;
+  
+  // undo and redo, the history follows the current field
+  History *history;
+  bool practice; // a click on a mine is taken back instead of ending the game
+  
+  // the game in progress is saved to save_path and continued from it on the next start, see snapshot.h,
+  // the tiles are copied on the main thread and written on a worker
+  char *save_path; // NULL if the game is not saved
+  Snapshot save;
+  SDL_Thread *saver;
+  SDL_atomic_t save_done;
+  uint32_t last_save;
+  bool unsaved; // the game changed since it was last saved
+  bool has_save; // the saved game is the current one, it is removed once the game is finished or given up
+  bool resume; // continue the saved game once the saves are read in
+  
+  // the probability overlay, counted on a worker thread from the tiles the main thread queues
+  bool odds_shown;
+  bool odds_resync; // queue every tile, the overlay was off while the game went on
+  SDL_Thread *odds_thread;
+  SDL_mutex *odds_lock; // guards the queue, the result and odds_quit
+  SDL_cond *odds_wake;
+  bool odds_quit;
+  int *odds_queue; // padded tile index and odds.h value pairs
+  int odds_queued; // ints in it
+  int odds_queue_capacity;
+  int *odds_taken; // the queue the worker is working through
+  int odds_taken_capacity;
+  int odds_width; // of the board the queue is for, the worker starts over when it changes
+  int odds_height;
+  int odds_mines;
+  Odds *odds; // only the worker touches it
+  float *odds_result; // per padded tile, a copy of odds->prob
+  int odds_result_width;
+  int odds_result_height;
+  SDL_atomic_t odds_ready; // a result the screen does not show yet
+  uint32_t odds_event; // wakes up the main loop when a result is ready
+  
+  #ifdef MINES_PROFILE
+  bool profile_shown; // the overlay, toggled with P
+  bool presented; // the last call of frame() drew a frame
+  #endif
+  
+  // --latency, from the timestamp of an input event to the return of the present that shows it
+  bool measure_latency;
+  uint32_t latency_pending[LATENCY_PENDING]; // timestamps of the inputs handled since the last present
+  int latency_n_pending;
+  uint32_t latency_histogram[LATENCY_MAX_MS+1]; // per ms
+  uint32_t latency_max;
+  int latency_samples;
+  int latency_reported; // samples in the last report
+  
   bool chord;
   bool run;
   } GameContext;
 
-Tile get_tile(MineField *field, int x, int y) {
-  if (x < 0 || x >= field->width)  return TILE_INVA;
-  if (y < 0 || y >= field->height) return TILE_INVA;
-  return field->tiles[x][y];
-  }
+// command line options
+typedef struct {
+  uint64_t seed;
+  bool no_guess;
+  int width;
+  int height;
+  int n_mines;
+  bool endless;
+  double density; // of endless games
+  const char *record;
+  const char *replay;
+  bool practice;
+  bool save; // save the game in progress
+  bool resume; // and continue the saved one
+  bool latency; // measure the input latency
+  } Options;
 
-uint8_t reveal(MineField *field, int x, int y) {
-  if (get_tile(field, x, y) == TILE_INVA) return TILE_INVA;
-  field->tiles[x][y] |= TILE_RVLD;
-  field->tiles[x][y] &= ~TILE_FLAG;
+// very large fields are packed, at 3 bits per tile instead of about 16 bytes, the rest live in the game
+// arena next to a spare for the generator, so games of the same size do not allocate, and the
+// arena grows to twice field_memory() of the largest board played
+MineField *create_board(GameContext *ctx, int width, int height, int n_mines) {
+  ctx->spare = NULL;
+  if ((long long) width * height >= PACKED_FIELD_TILES) {
+    arena_free(&ctx->game_arena);
+    return create_packed_field(width, height, n_mines);
+    }
   
-  field->tiles_unopened --;
-  return field->tiles[x][y];
+  size_t memory = 2 * field_memory(width, height);
+  if (memory > ctx->game_arena.capacity) {
+    arena_free(&ctx->game_arena);
+    arena_init(&ctx->game_arena, memory);
+    }
+  arena_reset(&ctx->game_arena);
+  MineField *field = create_field_in(&ctx->game_arena, width, height, n_mines);
+  ctx->spare = create_field_in(&ctx->game_arena, width, height, n_mines);
+  return field ? field : create_field(width, height, n_mines);
   }
 
-uint8_t check(MineField *field, int x, int y) {
-  if (get_tile(field, x, y) == TILE_INVA) return TILE_INVA;
-  return field->tiles[x][y];
+int get_n_mines(int width, int height, double density) {
+  int n = (int) (width * height * density);
+  return n > 0 ? n : 1;
   }
 
-void generate_field(MineField *field, int n_mines, int opening_x, int opening_y) {
-  int width = field->width;
-  int height = field->height;
-  
-  field->generated = true;
-  field->placed_flags = 0;
-  field->tiles_unopened = width * height;
-  
-  Tile **tiles = malloc(sizeof(Tile *) * width);
-  field->tiles = tiles;
+const Preset *find_preset(const char *name) {
+  for (int i=0;i<N_PRESETS;i++) {
+    if (strcmp(presets[i].name, name) == 0) return &presets[i];
+    }
+  return NULL;
+  }
+
+void update_title(GameContext *ctx) {
+  MineField *field = ctx->field;
+  char title[160];
+  char practice[48] = "";
+  if (field->practice) snprintf(practice, sizeof(practice), " - practice, %d rewinds", field->rewinds);
+  if (ctx->endless) snprintf(title, sizeof(title), "MineSweeper - endless - seed %llu", (unsigned long long) field->seed);
+  else snprintf(title, sizeof(title), "MineSweeper - %dx%d, %d mines - seed %llu%s%s%s", field->width, field->height, field->n_mines,
+    (unsigned long long) field->seed, field->no_guess ? " - no guess" : "", practice, ctx->replaying ? " - replay" : "");
+  SDL_SetWindowTitle(ctx->window, title);
+  }
+
+int run_generator(void *data) {
+  GameContext *ctx = data;
+  generate_field(ctx->pending, ctx->pending->n_mines, ctx->pending_x, ctx->pending_y);
+  SDL_AtomicSet(&ctx->pending_done, 1);
+  SDL_PushEvent(&(SDL_Event) {.type = ctx->pending_event});
+  return 0;
+  }
+
+// generates the board for a first click at (x, y) without blocking the frame,
+// falls back to generating in place where threads are unavailable
+void start_generator(GameContext *ctx, int x, int y) {
+  MineField *field = ctx->field;
   
-  for (int r=0;r<width;r++) {
-    tiles[r] = calloc(height, sizeof(Tile));
-    for (int c=0;c<height;c++) tiles[r][c] = TILE_INVA;
+  if (ctx->spare) {
+    ctx->pending = ctx->spare;
+    ctx->spare = NULL;
+    clear_field(ctx->pending);
+    ctx->pending->n_mines = field->n_mines;
     }
+  else ctx->pending = create_field(field->width, field->height, field->n_mines);
+  set_field_seed(ctx->pending, field->seed);
+  ctx->pending->no_guess = field->no_guess;
+  ctx->pending->no_guess_budget_ms = field->no_guess_budget_ms;
+  ctx->pending->history = field->history;
+  ctx->pending->practice = field->practice;
+  ctx->pending_x = x;
+  ctx->pending_y = y;
+  SDL_AtomicSet(&ctx->pending_done, 0);
+  
+  ctx->generator = SDL_CreateThread(run_generator, "generator", ctx);
+  if (!ctx->generator) run_generator(ctx);
+  }
+
+// appends an action to the recording unless the game ignored it
+void record_action(GameContext *ctx, int action, int x, int y, int state_before) {
+  MineField *field = ctx->field;
+  if (!ctx->record || ctx->endless || ctx->replaying || ctx->off_record) return;
+  if (state_before != GAME_PLAYING && (state_before != GAME_WAITING || field->state == GAME_WAITING)) return;
+  replay_record(&ctx->writer, ctx->record, field, SDL_GetTicks() - ctx->game_start, action, x, y);
+  }
+
+// closes the recording of the current game, whether it was finished or not
+void record_end(GameContext *ctx) {
+  if (ctx->record) replay_end(&ctx->writer, SDL_GetTicks() - ctx->game_start, field_state(ctx->field));
+  }
+
+// ends the recording of the current game where it is, the rest of it is not recorded
+void go_off_record(GameContext *ctx) {
+  record_end(ctx);
+  ctx->off_record = true;
+  }
+
+// a field of the game arena goes back to be the spare
+void drop_field(GameContext *ctx, MineField *field) {
+  if (field->in_arena) ctx->spare = field;
+  else destroy_field(field);
+  }
+
+// installs the pending board once it is ready, or drops it if discard is set
+void finish_generator(GameContext *ctx, bool discard) {
+  if (!ctx->pending) return;
+  if (!discard && !SDL_AtomicGet(&ctx->pending_done)) return;
   
-  int n = 0;
-  int i = 0;
-  int dx, dy, x, y;
+  if (ctx->generator) SDL_WaitThread(ctx->generator, NULL);
+  ctx->generator = NULL;
   
-  if (opening_x >= 0 && opening_y >= 0) {
-    int opening_size = width * height / n_mines / 3;
-    if (opening_size <= 2) opening_size = 3;
-    
-    int opening_radius = 1;
-    tiles[opening_x][opening_y] = TILE8;
-    
-    while (n < opening_size) {
-      if (i > opening_size * 4) break; // iteration limit
-      i ++;
-      
-      dx = rand() % opening_radius - opening_radius/2;
-      dy = rand() % opening_radius - opening_radius/2;
-      x = opening_x + dx;
-      y = opening_y + dy;
-      
-      if (!IN_FIELD(x, y, field)) continue;
-      
-      int tx, ty;
-      for (int k=0;k<18;k+=2) {
-        tx = x+offsets3x3[k];
-        ty = y+offsets3x3[k+1];
-        if (!IN_FIELD(tx, ty, field)) continue;
-        tiles[tx][ty] = TILE8;
-        }
-      
-      opening_radius ++;
-      n ++;
+  if (discard) drop_field(ctx, ctx->pending);
+  else {
+    drop_field(ctx, ctx->field);
+    ctx->field = ctx->pending;
+    field_open(ctx->field, ctx->pending_x, ctx->pending_y);
+    record_action(ctx, REPLAY_OPEN, ctx->pending_x, ctx->pending_y, GAME_WAITING);
+    ctx->redraw_board = true;
+    }
+  ctx->pending = NULL;
+  }
+
+// counts the probabilities for the tiles queued so far, false if there were none
+bool count_odds(GameContext *ctx) {
+  SDL_LockMutex(ctx->odds_lock);
+  int n = ctx->odds_queued;
+  int width = ctx->odds_width;
+  int height = ctx->odds_height;
+  int n_mines = ctx->odds_mines;
+  int *taken = ctx->odds_queue;
+  ctx->odds_queue = ctx->odds_taken;
+  ctx->odds_taken = taken;
+  int capacity = ctx->odds_queue_capacity;
+  ctx->odds_queue_capacity = ctx->odds_taken_capacity;
+  ctx->odds_taken_capacity = capacity;
+  ctx->odds_queued = 0;
+  SDL_UnlockMutex(ctx->odds_lock);
+  if (n == 0) return false;
+  
+  Odds *odds = ctx->odds;
+  if (!odds || odds->width != width || odds->height != height || odds->n_mines != n_mines) {
+    if (odds) destroy_odds(odds);
+    odds = ctx->odds = create_odds(width, height, n_mines);
+    }
+  for (int q=0;q<n;q+=2) odds_change(odds, taken[q] % odds->stride - 1, taken[q] / odds->stride - 1, taken[q+1]);
+  odds_compute(odds);
+  
+  SDL_LockMutex(ctx->odds_lock);
+  int n_tiles = odds->stride * (height + 2);
+  if (ctx->odds_result_width != width || ctx->odds_result_height != height) {
+    float *result = realloc(ctx->odds_result, sizeof(float) * n_tiles);
+    if (!result) {
+      SDL_UnlockMutex(ctx->odds_lock);
+      return true; // nothing to show, the overlay stays empty for this board
       }
+    ctx->odds_result = result;
+    ctx->odds_result_width = width;
+    ctx->odds_result_height = height;
     }
+  memcpy(ctx->odds_result, odds->prob, sizeof(float) * n_tiles);
+  SDL_UnlockMutex(ctx->odds_lock);
   
-  n = 0;
-  i = 0;
-  while (n < n_mines) {
-    x = rand() % width;
-    y = rand() % height;
-    
-    if (i > n_mines*2) break; // iteration limit
-    i ++;
-    
-    if (IS_MINE(tiles[x][y])) continue;
-    if (tiles[x][y] == TILE8) continue;
-    
-    tiles[x][y] |= TILE_MINE;
-    n ++;
+  SDL_AtomicSet(&ctx->odds_ready, 1);
+  SDL_PushEvent(&(SDL_Event) {.type = ctx->odds_event});
+  return true;
+  }
+
+int run_odds(void *data) {
+  GameContext *ctx = data;
+  SDL_LockMutex(ctx->odds_lock);
+  while (!ctx->odds_quit) {
+    if (ctx->odds_queued == 0) SDL_CondWait(ctx->odds_wake, ctx->odds_lock);
+    else {
+      SDL_UnlockMutex(ctx->odds_lock);
+      count_odds(ctx);
+      SDL_LockMutex(ctx->odds_lock);
+      }
     }
-  field->placed_mines = n;
-  
-  for (x=0;x<width;x++) {
-    for (y=0;y<height;y++) {
-      if (IS_MINE(tiles[x][y])) continue;
-      
-      uint8_t neighbors = 0;
-      
-      for (int i=0;i<16;i+=2) {
-        int neighbor_x = x + offsets3x3[i];
-        int neighbor_y = y + offsets3x3[i+1];
-        
-        if (!IN_FIELD(neighbor_x, neighbor_y, field)) continue;
-        if (!IS_MINE(get_tile(field, neighbor_x, neighbor_y))) continue;
-        neighbors ++;
-        }
-      
-      tiles[x][y] = neighbors;
+  SDL_UnlockMutex(ctx->odds_lock);
+  return 0;
+  }
+
+// the value of a tile as the player sees it
+int odds_value(Tile t) {
+  if (IS_RVLD(t)) return TILE_GET_NUMBER(t);
+  return IS_FLAG(t) ? ODDS_FLAG : ODDS_COVERED;
+  }
+
+// false if the queue could not grow, the tile is then left out
+bool queue_tile(GameContext *ctx, int i) {
+  MineField *field = ctx->field;
+  if (ctx->odds_queued + 2 > ctx->odds_queue_capacity) {
+    int capacity = ctx->odds_queue_capacity ? ctx->odds_queue_capacity * 2 : 1024;
+    int *queue = realloc(ctx->odds_queue, sizeof(int) * capacity);
+    if (!queue) return false;
+    ctx->odds_queue = queue;
+    ctx->odds_queue_capacity = capacity;
+    }
+  ctx->odds_queue[ctx->odds_queued++] = i;
+  ctx->odds_queue[ctx->odds_queued++] = odds_value(get_tile(field, i % field->stride - 1, i / field->stride - 1));
+  return true;
+  }
+
+// hands the tiles changed since the last frame to the worker, or counts in place without threads
+void queue_odds(GameContext *ctx) {
+  MineField *field = ctx->field;
+  if (ctx->endless || field->packed) return;
+  if (field->state != GAME_PLAYING) {
+    // the board is generated on the first click, until then its tiles are not the game's
+    if (field->state == GAME_WAITING) ctx->odds_resync = true;
+    return;
+    }
+  if (!ctx->odds_resync && !field->all_dirty && field->dirty_len == 0) return;
+  
+  SDL_LockMutex(ctx->odds_lock);
+  bool all = ctx->odds_resync || field->all_dirty;
+  // keyed on the mines that were placed, fewer than asked for when they did not fit
+  if (field->width != ctx->odds_width || field->height != ctx->odds_height || field->placed_mines != ctx->odds_mines) {
+    ctx->odds_width = field->width;
+    ctx->odds_height = field->height;
+    ctx->odds_mines = field->placed_mines;
+    ctx->odds_queued = 0;
+    all = true;
+    }
+  bool queued = true;
+  if (all) {
+    for (int y=0;y<field->height && queued;y++) {
+      for (int x=0;x<field->width && queued;x++) queued = queue_tile(ctx, TILE_INDEX(field, x, y));
       }
     }
+  else {
+    for (int d=0;d<field->dirty_len && queued;d++) queued = queue_tile(ctx, field->dirty[d]);
+    }
+  ctx->odds_resync = !queued; // tries again with every tile on the next frame
+  SDL_CondSignal(ctx->odds_wake);
+  SDL_UnlockMutex(ctx->odds_lock);
+  
+  if (!ctx->odds_thread) count_odds(ctx);
   }
 
-void clear_field(MineField *field) {
-  if (!field->generated) return;
-  for (int r=0;r<field->width;r++) {
-    free(field->tiles[r]);
+void toggle_odds(GameContext *ctx) {
+  ctx->odds_shown = !ctx->odds_shown;
+  ctx->odds_resync = true;
+  if (ctx->odds_shown && !ctx->odds_lock) {
+    ctx->odds_lock = SDL_CreateMutex();
+    ctx->odds_wake = SDL_CreateCond();
+    ctx->odds_thread = SDL_CreateThread(run_odds, "odds", ctx);
     }
-  free(field->tiles);
-  field->generated = false;
   }
 
-// recursive, returns true if a mine was revealed
-bool dig(MineField *field, int x, int y) {
-  if (!IN_FIELD(x, y, field)) return false;
+void stop_odds(GameContext *ctx) {
+  if (ctx->odds_thread) {
+    SDL_LockMutex(ctx->odds_lock);
+    ctx->odds_quit = true;
+    SDL_CondSignal(ctx->odds_wake);
+    SDL_UnlockMutex(ctx->odds_lock);
+    SDL_WaitThread(ctx->odds_thread, NULL);
+    }
   
-  Tile t = field->tiles[x][y];
-  bool m = false;
+  SDL_DestroyCond(ctx->odds_wake);
+  SDL_DestroyMutex(ctx->odds_lock);
+  if (ctx->odds) destroy_odds(ctx->odds);
+  free(ctx->odds_queue);
+  free(ctx->odds_taken);
+  free(ctx->odds_result);
+  }
+
+// the first click of a no guess game goes to the generator
+void open_tile(GameContext *ctx, int x, int y) {
+  if (ctx->pending || ctx->replaying) return;
+  MineField *field = ctx->field;
+  int state = field->state;
+  if (ctx->endless) {
+    if (x != NO_TILE) endless_open(ctx->endless, x, y);
+    }
+  else if (field->state == GAME_WAITING && field->no_guess && !field->packed && IN_FIELD(x, y, field)) start_generator(ctx, x, y);
+  else {
+    field_open(field, x, y);
+    record_action(ctx, REPLAY_OPEN, x, y, state);
+    }
+  }
+
+void flag_tile(GameContext *ctx, int x, int y) {
+  if (ctx->replaying) return;
+  int state = ctx->field->state;
+  if (ctx->endless) {
+    if (x != NO_TILE) endless_flag(ctx->endless, x, y);
+    }
+  else {
+    field_flag(ctx->field, x, y);
+    record_action(ctx, REPLAY_FLAG, x, y, state);
+    }
+  }
+
+void chord_tile(GameContext *ctx, int x, int y) {
+  if (ctx->replaying) return;
+  int state = ctx->field->state;
+  if (ctx->endless) {
+    if (x != NO_TILE) endless_chord(ctx->endless, x, y);
+    }
+  else {
+    field_chord(ctx->field, x, y);
+    record_action(ctx, REPLAY_CHORD, x, y, state);
+    }
+  }
+
+// takes back the last move, or plays the last one taken back again
+void undo_move(GameContext *ctx, bool redo) {
+  if (ctx->endless || ctx->pending || ctx->replaying) return;
+  if (redo ? field_redo(ctx->field) : field_undo(ctx->field)) go_off_record(ctx);
+  }
+
+void toggle_practice(GameContext *ctx) {
+  if (ctx->endless || ctx->pending || ctx->replaying) return;
+  ctx->practice = !ctx->practice;
+  ctx->field->practice = ctx->practice;
+  if (ctx->practice) go_off_record(ctx);
+  update_title(ctx);
+  }
+
+int game_state(GameContext *ctx) {
+  if (ctx->endless) return ctx->endless->state;
+  return field_state(ctx->field);
+  }
+
+bool has_tile(GameContext *ctx, int x, int y) {
+  if (ctx->endless) return x != NO_TILE && y != NO_TILE;
+  return IN_FIELD(x, y, ctx->field);
+  }
+
+// the tile as it is drawn, covered everywhere until the first click
+Tile view_tile(GameContext *ctx, int x, int y) {
+  if (ctx->endless) return endless_get_tile(ctx->endless, x, y);
+  if (ctx->field->state == GAME_WAITING) return TILE0;
+  return get_tile(ctx->field, x, y);
+  }
+
+float get_tile_size(GameContext *ctx) {
+  return TILE_SIZE * ctx->zoom;
+  }
+
+// keeps the field on screen, a field smaller than the view is centered
+void clamp_camera(GameContext *ctx) {
+  if (ctx->endless) return;
+  float tile_size = get_tile_size(ctx);
+  float max_x = ctx->field->width*tile_size - ctx->view_w;
+  float max_y = ctx->field->height*tile_size - ctx->view_h;
+  
+  if (max_x < 0) ctx->camera_x = max_x/2;
+  else if (ctx->camera_x < 0) ctx->camera_x = 0;
+  else if (ctx->camera_x > max_x) ctx->camera_x = max_x;
+  
+  if (max_y < 0) ctx->camera_y = max_y/2;
+  else if (ctx->camera_y < 0) ctx->camera_y = 0;
+  else if (ctx->camera_y > max_y) ctx->camera_y = max_y;
+  }
+
+void pan_camera(GameContext *ctx, float dx, float dy) {
+  ctx->camera_x += dx;
+  ctx->camera_y += dy;
+  clamp_camera(ctx);
+  ctx->redraw_board = true;
+  }
+
+// zooms keeping the point under (screen_x, screen_y) in place
+void zoom_camera(GameContext *ctx, float zoom, int screen_x, int screen_y) {
+  if (zoom < MIN_ZOOM) zoom = MIN_ZOOM;
+  if (zoom > MAX_ZOOM) zoom = MAX_ZOOM;
+  
+  float anchor_x = screen_x - ctx->field_screen_x;
+  float anchor_y = screen_y - ctx->field_screen_y;
+  ctx->camera_x = (ctx->camera_x + anchor_x) * zoom / ctx->zoom - anchor_x;
+  ctx->camera_y = (ctx->camera_y + anchor_y) * zoom / ctx->zoom - anchor_y;
+  ctx->zoom = zoom;
+  clamp_camera(ctx);
+  ctx->redraw_board = true;
+  }
+
+int floor_to_int(float v) {
+  int i = (int) v;
+  return v < i ? i-1 : i;
+  }
+
+// the tile under a point of the screen, NO_TILE outside of the view
+void screen_to_tile(GameContext *ctx, int screen_x, int screen_y, int *x, int *y) {
+  float tile_size = get_tile_size(ctx);
+  float px = screen_x - ctx->field_screen_x;
+  float py = screen_y - ctx->field_screen_y;
+  
+  if (px < 0 || py < 0 || px >= ctx->view_w || py >= ctx->view_h) {
+    *x = NO_TILE;
+    *y = NO_TILE;
+    return;
+    }
+  *x = floor_to_int((px + ctx->camera_x) / tile_size);
+  *y = floor_to_int((py + ctx->camera_y) / tile_size);
+  }
+
+// the range of tiles that are at least partly inside the view, end exclusive
+void get_visible_tiles(GameContext *ctx, int *x0, int *y0, int *x1, int *y1) {
+  float tile_size = get_tile_size(ctx);
+  *x0 = floor_to_int(ctx->camera_x / tile_size);
+  *y0 = floor_to_int(ctx->camera_y / tile_size);
+  *x1 = floor_to_int((ctx->camera_x + ctx->view_w) / tile_size) + 1;
+  *y1 = floor_to_int((ctx->camera_y + ctx->view_h) / tile_size) + 1;
+  if (ctx->endless) return;
+  
+  if (*x0 < 0) *x0 = 0;
+  if (*y0 < 0) *y0 = 0;
+  if (*x1 > ctx->field->width) *x1 = ctx->field->width;
+  if (*y1 > ctx->field->height) *y1 = ctx->field->height;
+  }
+
+// fits the window, the board cache and the top bar to the size of the field,
+// fields larger than the display get a view of the largest size that fits
+void resize_window(GameContext *ctx) {
+  Button *big_button = (Button *) ctx->widgets[WIDGET_BIG_BUTTON];
+  NumberDisplay *mine_display = (NumberDisplay *) ctx->widgets[WIDGET_MINE_DISPLAY];
+  int width = ctx->endless ? ENDLESS_VIEW_WIDTH : ctx->field->width;
+  int height = ctx->endless ? ENDLESS_VIEW_HEIGHT : ctx->field->height;
+  
+  SDL_Rect display = {0, 0, 1280, 800};
+  SDL_GetDisplayUsableBounds(SDL_GetWindowDisplayIndex(ctx->window), &display);
+  int max_w = display.w - PADDING*2-6 - WINDOW_MARGIN;
+  int max_h = display.h - TOPBAR_HEIGHT-PADDING-3 - WINDOW_MARGIN;
+  if (max_w < MIN_FIELD_WIDTH*TILE_SIZE) max_w = MIN_FIELD_WIDTH*TILE_SIZE;
+  if (max_h < TILE_SIZE) max_h = TILE_SIZE;
+  
+  ctx->view_w = width*TILE_SIZE < max_w ? width*TILE_SIZE : max_w;
+  ctx->view_h = height*TILE_SIZE < max_h ? height*TILE_SIZE : max_h;
+  ctx->zoom = 1;
+  ctx->camera_x = 0;
+  ctx->camera_y = 0;
+  if (ctx->endless) {
+    ctx->camera_x = (TILE_SIZE - ctx->view_w) / 2; // tile (0, 0) in the middle
+    ctx->camera_y = (TILE_SIZE - ctx->view_h) / 2;
+    }
+  clamp_camera(ctx);
   
-  if (IS_FLAG(t)) return m;
-  if (IS_RVLD(t)) return m;
-  m = m | IS_MINE(reveal(field, x, y));
-  if (!IS_EMPTY(t)) return m;
-  if (IS_MINE(t)) return m;
+  int win_width = ctx->view_w+PADDING*2+6;
+  int win_height = ctx->view_h+TOPBAR_HEIGHT+PADDING+3;
+  SDL_SetWindowSize(ctx->window, win_width, win_height);
   
-  for (int i=0;i<16;i+=2) {
-    int neighbor_x = x + offsets3x3[i];
-    int neighbor_y = y + offsets3x3[i+1];
-    t = check(field, neighbor_x, neighbor_y);
-    if (t == TILE_INVA) continue;
-    
-    if (IS_MINE(t)) m = true;
-    if (dig(field, neighbor_x, neighbor_y)) m = true;
+  if (ctx->board) SDL_DestroyTexture(ctx->board);
+  ctx->board = NULL;
+  if (SDL_RenderTargetSupported(ctx->renderer)) {
+    ctx->board = SDL_CreateTexture(ctx->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, win_width, win_height);
+    if (ctx->board) SDL_SetTextureBlendMode(ctx->board, SDL_BLENDMODE_NONE);
     }
+  ctx->redraw_board = true;
+  ctx->redraw = true;
   
-  return m;
+  int digits = ctx->endless ? ENDLESS_DIGITS : count_digits(width*height) + 1;
+  mine_display->digits = (digits >= 3) ? digits : 3;
+  
+  // centered unless a wide display would overlap it
+  int display_end = mine_display->x + 23*mine_display->digits+4 + PADDING;
+  big_button->x = win_width/2-19;
+  if (big_button->x < display_end) big_button->x = display_end;
   }
 
-void show_all(MineField *field, bool flagmines) {
-  for (int x=0;x<field->width;x++) {
-    for (int y=0;y<field->height;y++) {
-      
-      Tile t = field->tiles[x][y];
-      if (IS_FLAG(t)) {
-        if (!IS_MINE(t)) {
-          field->tiles[x][y] |= TILE_WFLG;
-          }
-        }
-      else if (IS_MINE(t) && flagmines) {
-        field->tiles[x][y] |= TILE_FLAG;
-        }
-      else {
-        field->tiles[x][y] |= TILE_RVLD;
-        }
-      }
+// the place of the saved game, in the user's app data, or in IndexedDB for the web build, whose
+// saves are read in asynchronously, see saves_ready
+char *find_save_path() {
+  #ifdef __EMSCRIPTEN__
+  EM_ASM(
+    Module.savesReady = false;
+    try { FS.mkdir('/save'); } catch (e) {}
+    FS.mount(IDBFS, {}, '/save');
+    FS.syncfs(true, function (err) { Module.savesReady = true; });
+  );
+  return strdup("/save/" SAVE_FILE);
+  #else
+  char *dir = SDL_GetPrefPath("mkac003", "mines");
+  if (!dir) return NULL;
+  char *path = malloc(strlen(dir) + sizeof(SAVE_FILE));
+  strcpy(path, dir);
+  strcat(path, SAVE_FILE);
+  SDL_free(dir);
+  return path;
+  #endif
+  }
+
+bool saves_ready() {
+  #ifdef __EMSCRIPTEN__
+  return EM_ASM_INT(return Module.savesReady ? 1 : 0;);
+  #else
+  return true;
+  #endif
+  }
+
+// writes the saves of the web build back to IndexedDB
+void persist_saves() {
+  #ifdef __EMSCRIPTEN__
+  EM_ASM(FS.syncfs(false, function (err) {}););
+  #endif
+  }
+
+// only a game being played is saved, not an endless one or a playback
+bool can_save(GameContext *ctx) {
+  return ctx->save_path && !ctx->endless && !ctx->replaying && !ctx->pending && ctx->field->state == GAME_PLAYING;
+  }
+
+int run_saver(void *data) {
+  GameContext *ctx = data;
+  write_snapshot(&ctx->save, ctx->save_path);
+  SDL_AtomicSet(&ctx->save_done, 1);
+  return 0;
+  }
+
+// collects the save running in the background once it is done, or waits for it
+void finish_saver(GameContext *ctx, bool wait) {
+  if (!ctx->saver || (!wait && !SDL_AtomicGet(&ctx->save_done))) return;
+  SDL_WaitThread(ctx->saver, NULL);
+  ctx->saver = NULL;
+  persist_saves();
+  }
+
+// saves the game in progress at most every AUTOSAVE_MS while it changes, the frame only waits for the copy
+// of the tiles, falls back to writing in place where threads are unavailable
+void autosave(GameContext *ctx) {
+  finish_saver(ctx, false);
+  if (ctx->saver || !ctx->unsaved || !can_save(ctx)) return;
+  if (SDL_GetTicks() - ctx->last_save < AUTOSAVE_MS && ctx->has_save) return;
+  ctx->last_save = SDL_GetTicks();
+  ctx->unsaved = false;
+  if (!take_snapshot(&ctx->save, ctx->field)) return;
+  
+  ctx->has_save = true;
+  SDL_AtomicSet(&ctx->save_done, 0);
+  ctx->saver = SDL_CreateThread(run_saver, "saver", ctx);
+  if (!ctx->saver) {
+    run_saver(ctx);
+    persist_saves();
     }
   }
 
-// returns true if a mine has been reached
-bool run_chord(MineField *field, int hovered_tile_x, int hovered_tile_y) {
-  Tile t;
-  uint8_t flags = 0;
-  bool m = false;
-  
-  if (!IN_FIELD(hovered_tile_x, hovered_tile_y, field)) return m;
-  if (!IS_RVLD(field->tiles[hovered_tile_x][hovered_tile_y])) return m;
-  
-  for (int i=0;i<16;i+=2) {
-    int x = hovered_tile_x + offsets3x3[i];
-    int y = hovered_tile_y + offsets3x3[i+1];
-    
-    if (!IN_FIELD(x, y, field)) continue;
-    
-    t = field->tiles[x][y];
-    if (IS_FLAG(t)) flags ++;
+// removes the saved game once the game it holds is finished or given up
+void forget_save(GameContext *ctx) {
+  if (!ctx->has_save) return;
+  finish_saver(ctx, true);
+  remove(ctx->save_path);
+  persist_saves();
+  ctx->has_save = false;
+  }
+
+void stop_replay(GameContext *ctx) {
+  if (ctx->replay.file) fclose(ctx->replay.file);
+  ctx->replay.file = NULL;
+  ctx->replaying = false;
+  update_title(ctx);
+  }
+
+// prepares a board with the given seed, generated on the first click,
+// a field of a different size replaces the current one
+void new_game(GameContext *ctx, uint64_t seed) {
+  finish_generator(ctx, true);
+  record_end(ctx);
+  forget_save(ctx);
+  if (ctx->replaying) stop_replay(ctx);
+  bool resize = ctx->endless || ctx->endless_mode;
+  if (ctx->field->width != ctx->width || ctx->field->height != ctx->height) {
+    bool no_guess = ctx->field->no_guess;
+    destroy_field(ctx->field);
+    ctx->field = create_board(ctx, ctx->width, ctx->height, ctx->n_mines);
+    ctx->field->no_guess = no_guess;
+    resize = true;
+    }
+  else clear_field(ctx->field);
+  ctx->field->n_mines = ctx->n_mines;
+  ctx->field->no_guess_fixed_attempts = 0; // set by a playback
+  ctx->field->history = ctx->history;
+  ctx->field->practice = ctx->practice;
+  ctx->off_record = ctx->practice;
+  set_field_seed(ctx->field, seed);
+  
+  if (ctx->endless) destroy_endless(ctx->endless);
+  ctx->endless = ctx->endless_mode ? create_endless(seed, ctx->endless_density) : NULL;
+  if (resize) resize_window(ctx);
+  ctx->redraw_board = true;
+  ctx->game_start = SDL_GetTicks();
+  update_title(ctx);
+  }
+
+// continues the game the last session left unfinished, if it saved one that is not broken
+void resume_game(GameContext *ctx) {
+  ctx->resume = false;
+  if (!ctx->save_path || ctx->endless || ctx->replaying || ctx->pending || ctx->field->state != GAME_WAITING) return;
+  MineField *field = load_snapshot(ctx->save_path, NULL);
+  if (!field) return;
+  if (field->state != GAME_PLAYING || field->width < MIN_FIELD_WIDTH || field->width > MAX_FIELD_SIZE || field->height > MAX_FIELD_SIZE) {
+    destroy_field(field);
+    return;
     }
   
-  if (flags != TILE_GET_NUMBER(field->tiles[hovered_tile_x][hovered_tile_y])) return m;
-  for (int i=0;i<16;i+=2) {
-    int x = hovered_tile_x + offsets3x3[i];
-    int y = hovered_tile_y + offsets3x3[i+1];
-    
-    if (!IN_FIELD(x, y, field)) continue;
-    
-    t = field->tiles[x][y];
-    if (IS_FLAG(t)) continue;
-    
-    bool a = dig(field, x, y);
-    m = m | a;
+  ctx->endless_mode = false;
+  ctx->width = field->width;
+  ctx->height = field->height;
+  ctx->n_mines = field->n_mines;
+  new_game(ctx, field->seed);
+  drop_field(ctx, ctx->field);
+  ctx->field = field;
+  field->history = ctx->history;
+  field->practice = ctx->practice;
+  if (ctx->history) clear_history(ctx->history);
+  ctx->off_record = true; // a recording has to start from the opening click
+  ctx->has_save = true;
+  ctx->redraw_board = true;
+  update_title(ctx);
+  }
+
+// sets up the next game of the playback on a field made from its header, the playback
+// ends with the stream or at a game the window cannot show
+void next_replay_game(GameContext *ctx) {
+  ReplayHeader *header = &ctx->replay.header;
+  bool ok = replay_next_game(&ctx->replay);
+  while (ok && (header->width < MIN_FIELD_WIDTH || header->width > MAX_FIELD_SIZE || header->height > MAX_FIELD_SIZE)) {
+    ok = replay_next_game(&ctx->replay);
+    }
+  if (!ok || !replay_next_action(&ctx->replay, &ctx->next_action)) {
+    stop_replay(ctx);
+    return;
     }
   
-  return m;
+  ctx->replaying = false; // new_game ends a playback
+  ctx->endless_mode = false;
+  ctx->width = header->width;
+  ctx->height = header->height;
+  ctx->n_mines = header->n_mines;
+  new_game(ctx, header->seed);
+  ctx->replaying = true;
+  
+  // the layout and the no guess attempts have to be those of the recording,
+  // the board of the new game has the same layout unless it was recorded elsewhere
+  if (ctx->field->packed != ((header->flags & REPLAY_PACKED) != 0)) {
+    MineField *field = replay_create_field(header, NULL);
+    if (!field) {
+      stop_replay(ctx);
+      return;
+      }
+    destroy_field(ctx->field);
+    ctx->field = field;
+    }
+  ctx->field->no_guess = header->flags & REPLAY_NO_GUESS;
+  ctx->field->no_guess_fixed_attempts = header->attempts;
+  ctx->field->practice = false; // recordings are of games without rewinds
+  ctx->replay_time = 0;
+  ctx->replay_last = SDL_GetTicks();
+  update_title(ctx);
+  }
+
+void start_replay(GameContext *ctx, const char *path) {
+  ctx->replay = (ReplayReader) {.file = fopen(path, "rb")};
+  if (!ctx->replay.file) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return;
+    }
+  next_replay_game(ctx);
+  }
+
+// the next record of the playback and when it is due in the time of the game
+uint32_t replay_due(GameContext *ctx) {
+  ReplayAction *action = &ctx->next_action;
+  return action->tick + (action->action == REPLAY_END ? REPLAY_END_PAUSE_MS : 0);
   }
 
-void flip_flag(MineField *field, int x, int y) {
-  if (!IN_FIELD(x, y, field)) return;
-  field->tiles[x][y] ^= TILE_FLAG;
-  if (IS_FLAG(field->tiles[x][y])) field->placed_flags ++;
-  else field->placed_flags --;
+// applies the recorded actions that are due
+void run_replay(GameContext *ctx) {
+  uint32_t now = SDL_GetTicks();
+  ctx->replay_time += (now - ctx->replay_last) * (ctx->fast_forward ? REPLAY_FAST_FORWARD : 1);
+  ctx->replay_last = now;
+  
+  while (ctx->replaying && replay_due(ctx) <= ctx->replay_time) {
+    if (ctx->next_action.action == REPLAY_END) next_replay_game(ctx);
+    else {
+      replay_apply(ctx->field, &ctx->next_action);
+      if (!replay_next_action(&ctx->replay, &ctx->next_action)) next_replay_game(ctx); // cut short
+      }
+    }
   }
 
-void game_over(GameContext *ctx) {
-  ctx->game_state = GAME_OVER;
-  show_all(ctx->field, false);
-  ((Button *) ctx->widgets[WIDGET_BIG_BUTTON])->image = IMG_BIG_RETRY;
+// how long the native loop may sleep, a playback wakes it up when the next action is due
+// and a frame held back by the frame rate cap once it may be drawn
+uint32_t idle_wait(GameContext *ctx) {
+  uint32_t wait = IDLE_WAIT_MS;
+  if (ctx->redraw && !ctx->vsync) {
+    uint32_t elapsed = SDL_GetTicks() - ctx->last_present;
+    wait = elapsed < FRAME_MS ? FRAME_MS - elapsed : 0;
+    }
+  if (!ctx->replaying) return wait;
+  uint32_t due = replay_due(ctx);
+  uint32_t until = due > ctx->replay_time ? (due - ctx->replay_time) / (ctx->fast_forward ? REPLAY_FAST_FORWARD : 1) : 0;
+  if (until < 1) until = 1;
+  return until < wait ? until : wait;
   }
 
-int get_n_mines() {
-  return STARTING_FIELD_WIDTH*STARTING_FIELD_HEIGHT/6;
+uint64_t next_seed(GameContext *ctx) {
+  return (uint64_t) rng_next(&ctx->seeds) << 32 | rng_next(&ctx->seeds);
   }
 
-void start_game(GameContext *ctx, int hovered_tile_x, int hovered_tile_y) {
-  generate_field(ctx->field, get_n_mines(), hovered_tile_x, hovered_tile_y);
-  int digits = count_digits(ctx->field->width*ctx->field->height) + 1;
-  ((NumberDisplay *) ctx->widgets[WIDGET_MINE_DISPLAY])->digits = (digits >= 3) ? digits : 3;
-  ctx->game_state = GAME_PLAYING;
-  dig(ctx->field, hovered_tile_x, hovered_tile_y);
+// starts a new game with the size and mine count of a preset
+void set_preset(GameContext *ctx, const Preset *preset) {
+  ctx->endless_mode = false;
+  ctx->width = preset->width;
+  ctx->height = preset->height;
+  ctx->n_mines = preset->n_mines;
+  new_game(ctx, next_seed(ctx));
   }
 
-void init(GameContext *ctx) {
+// prints the seed of the current board and copies it to the clipboard
+void export_seed(GameContext *ctx) {
+  char seed[24];
+  snprintf(seed, sizeof(seed), "%llu", (unsigned long long) ctx->field->seed);
+  printf("seed %s\n", seed);
+  SDL_SetClipboardText(seed);
+  }
+
+// updates the widgets after an action changed the game state
+void update_widgets(GameContext *ctx) {
+  Button *big_button = (Button *) ctx->widgets[WIDGET_BIG_BUTTON];
+  NumberDisplay *mine_display = (NumberDisplay *) ctx->widgets[WIDGET_MINE_DISPLAY];
+  
+  switch (game_state(ctx)) {
+    case GAME_OVER: big_button->image = IMG_BIG_RETRY; break;
+    case GAME_WON:  big_button->image = IMG_BIG_WON; break;
+    default:        big_button->image = IMG_BIG_FLAG; break;
+    }
+  
+  if (!ctx->endless) mine_display->value = field_mines_left(ctx->field);
+  else mine_display->value = ctx->endless->tiles_opened < 999999 ? ctx->endless->tiles_opened : 999999;
+  }
+
+const char *image_paths[IMG_COUNT] = {
+  "res/tile0.png",
+  "res/tile1.png",
+  "res/tile2.png",
+  "res/tile3.png",
+  "res/tile4.png",
+  "res/tile5.png",
+  "res/tile6.png",
+  "res/tile7.png",
+  "res/tile8.png",
+  "res/tile_bomb.png",
+  "res/tile_flag.png",
+  "res/unknown.png",
+  "res/unknown_inset.png",
+  "res/opened.png",
+  "res/bigbutton_flag.png",
+  "res/bigbutton_mine.png",
+  "res/bigbutton_retry.png",
+  "res/bigbutton_won.png",
+  "res/tile_wrong_flag.png",
+  "res/7seg0.png",
+  "res/7seg1.png",
+  "res/7seg2.png",
+  "res/7seg3.png",
+  "res/7seg4.png",
+  "res/7seg5.png",
+  "res/7seg6.png",
+  "res/7seg7.png",
+  "res/7seg8.png",
+  "res/7seg9.png",
+  "res/7segbg.png",
+  "res/7segminus.png",
+  };
+
+#define ATLAS_WIDTH 256
+
+// loads every image and packs them into rows of one texture
+void load_atlas(SDL_Renderer *renderer, Atlas *atlas) {
+  SDL_Surface *images[IMG_COUNT];
+  int x = 0;
+  int y = 0;
+  int row_height = 0;
+  
+  for (int i=0;i<IMG_COUNT;i++) {
+    images[i] = IMG_Load(image_paths[i]);
+    int w = images[i] ? images[i]->w : 0;
+    int h = images[i] ? images[i]->h : 0;
+    
+    if (x + w > ATLAS_WIDTH) {
+      x = 0;
+      y += row_height + 1;
+      row_height = 0;
+      }
+    atlas->sprites[i] = (SDL_Rect) {x, y, w, h};
+    x += w + 1;
+    if (h > row_height) row_height = h;
+    }
+  
+  atlas->w = ATLAS_WIDTH;
+  atlas->h = y + row_height;
+  
+  SDL_Surface *sheet = SDL_CreateRGBSurfaceWithFormat(0, atlas->w, atlas->h, 32, SDL_PIXELFORMAT_RGBA32);
+  SDL_FillRect(sheet, NULL, 0);
+  for (int i=0;i<IMG_COUNT;i++) {
+    if (!images[i]) continue;
+    SDL_SetSurfaceBlendMode(images[i], SDL_BLENDMODE_NONE);
+    SDL_BlitSurface(images[i], NULL, sheet, &atlas->sprites[i]);
+    SDL_FreeSurface(images[i]);
+    }
+  
+  atlas->texture = SDL_CreateTextureFromSurface(renderer, sheet);
+  SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+  SDL_FreeSurface(sheet);
+  }
+
+void init(GameContext *ctx, Options *options) {
   SDL_Init(SDL_INIT_TIMER | SDL_INIT_VIDEO | SDL_INIT_EVENTS);
   IMG_Init(IMG_INIT_PNG);
-  srand(time(NULL));
   
   SDL_SetHint(SDL_HINT_RENDER_BATCHING, "1"); // experimental
   
   ctx->window = SDL_CreateWindow("MineSweeper", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 50, 50, SDL_WINDOW_HIDDEN);
   ctx->renderer = SDL_CreateRenderer(ctx->window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+  if (!ctx->renderer) ctx->renderer = SDL_CreateRenderer(ctx->window, -1, 0); // e.g. no GPU
   ctx->run = true;
   
-  SDL_Texture *textures[] = {
-    IMG_LoadTexture(ctx->renderer, "res/tile0.png"),
-    IMG_LoadTexture(ctx->renderer, "res/tile1.png"),
-    IMG_LoadTexture(ctx->renderer, "res/tile2.png"),
-    IMG_LoadTexture(ctx->renderer, "res/tile3.png"),
-    IMG_LoadTexture(ctx->renderer, "res/tile4.png"),
-    IMG_LoadTexture(ctx->renderer, "res/tile5.png"),
-    IMG_LoadTexture(ctx->renderer, "res/tile6.png"),
-    IMG_LoadTexture(ctx->renderer, "res/tile7.png"),
-    IMG_LoadTexture(ctx->renderer, "res/tile8.png"),
-    IMG_LoadTexture(ctx->renderer, "res/tile_bomb.png"),
-    IMG_LoadTexture(ctx->renderer, "res/tile_flag.png"),
-    IMG_LoadTexture(ctx->renderer, "res/unknown.png"),
-    IMG_LoadTexture(ctx->renderer, "res/unknown_inset.png"),
-    IMG_LoadTexture(ctx->renderer, "res/opened.png"),
-    IMG_LoadTexture(ctx->renderer, "res/bigbutton_flag.png"),
-    IMG_LoadTexture(ctx->renderer, "res/bigbutton_mine.png"),
-    IMG_LoadTexture(ctx->renderer, "res/bigbutton_retry.png"),
-    IMG_LoadTexture(ctx->renderer, "res/bigbutton_won.png"),
-    IMG_LoadTexture(ctx->renderer, "res/tile_wrong_flag.png"),
-    IMG_LoadTexture(ctx->renderer, "res/7seg0.png"),
-    IMG_LoadTexture(ctx->renderer, "res/7seg1.png"),
-    IMG_LoadTexture(ctx->renderer, "res/7seg2.png"),
-    IMG_LoadTexture(ctx->renderer, "res/7seg3.png"),
-    IMG_LoadTexture(ctx->renderer, "res/7seg4.png"),
-    IMG_LoadTexture(ctx->renderer, "res/7seg5.png"),
-    IMG_LoadTexture(ctx->renderer, "res/7seg6.png"),
-    IMG_LoadTexture(ctx->renderer, "res/7seg7.png"),
-    IMG_LoadTexture(ctx->renderer, "res/7seg8.png"),
-    IMG_LoadTexture(ctx->renderer, "res/7seg9.png"),
-    IMG_LoadTexture(ctx->renderer, "res/7segbg.png"),
-    IMG_LoadTexture(ctx->renderer, "res/7segminus.png"),
-    };
+  SDL_RendererInfo info;
+  ctx->vsync = SDL_GetRendererInfo(ctx->renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+  ctx->last_present = 0;
+  ctx->redraw = true;
+  ctx->mouse_buttons = SDL_GetMouseState(&ctx->mouse_x, &ctx->mouse_y);
   
-  ctx->textures = malloc(sizeof(textures));
-  memcpy(ctx->textures, textures, sizeof(textures));
+  load_atlas(ctx->renderer, &ctx->atlas);
+  ctx->batch = create_batch(&ctx->arena);
   
   SDL_Surface *icon = IMG_Load("res/tile8.png");
   SDL_SetWindowIcon(ctx->window, icon);
@@ -543,44 +1301,336 @@ void init(GameContext *ctx) {
   
   ctx->field_screen_x = PADDING+3;
   ctx->field_screen_y = TOPBAR_HEIGHT;
-  
-  ctx->field = calloc(1, sizeof(MineField));
-  ctx->field->generated = false;
-  ctx->field->width = STARTING_FIELD_WIDTH;
-  ctx->field->height = STARTING_FIELD_HEIGHT;
-  
+  ctx->panning = false;
+  
+  ctx->width = options->width;
+  ctx->height = options->height;
+  ctx->n_mines = options->n_mines;
+  ctx->endless_mode = options->endless;
+  ctx->endless_density = options->density;
+  ctx->endless = NULL;
+  ctx->game_arena = (Arena) {0};
+  ctx->field = create_board(ctx, ctx->width, ctx->height, ctx->n_mines);
+  ctx->field->no_guess = options->no_guess;
   ctx->chord = false;
-  ctx->game_state = GAME_WAITING;
-  
-  int win_width = ctx->field->width*TILE_SIZE+PADDING*2+6;
-  int win_height = ctx->field->height*TILE_SIZE+TOPBAR_HEIGHT+PADDING+3;
-  SDL_SetWindowSize(ctx->window, win_width, win_height);
-  SDL_SetWindowPosition(ctx->window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
-  
-  void *widgets[] = {
+  ctx->generator = NULL;
+  ctx->pending = NULL;
+  ctx->pending_event = SDL_RegisterEvents(1);
+  rng_seed(&ctx->seeds, options->seed);
+  ctx->board = NULL;
+  
+  ctx->record = NULL;
+  if (options->record && !(ctx->record = fopen(options->record, "ab"))) fprintf(stderr, "cannot open %s\n", options->record);
+  ctx->writer = (ReplayWriter) {0};
+  ctx->off_record = false;
+  ctx->replaying = false;
+  ctx->replay = (ReplayReader) {0};
+  ctx->fast_forward = false;
+  
+  ctx->history = create_history(HISTORY_WORDS);
+  ctx->practice = options->practice;
+  
+  ctx->save_path = options->save ? find_save_path() : NULL;
+  ctx->save = (Snapshot) {0};
+  ctx->saver = NULL;
+  SDL_AtomicSet(&ctx->save_done, 0);
+  ctx->last_save = 0;
+  ctx->unsaved = false;
+  ctx->has_save = false;
+  ctx->resume = options->resume && ctx->save_path;
+  
+  ctx->odds_shown = false;
+  ctx->odds_resync = false;
+  ctx->odds_thread = NULL;
+  ctx->odds_lock = NULL;
+  ctx->odds_wake = NULL;
+  ctx->odds_quit = false;
+  ctx->odds_queue = NULL;
+  ctx->odds_queued = 0;
+  ctx->odds_queue_capacity = 0;
+  ctx->odds_taken = NULL;
+  ctx->odds_taken_capacity = 0;
+  ctx->odds_width = 0;
+  ctx->odds_height = 0;
+  ctx->odds_mines = 0;
+  ctx->odds = NULL;
+  ctx->odds_result = NULL;
+  ctx->odds_result_width = 0;
+  ctx->odds_result_height = 0;
+  SDL_AtomicSet(&ctx->odds_ready, 0);
+  ctx->odds_event = SDL_RegisterEvents(1);
+  #ifdef MINES_PROFILE
+  ctx->profile_shown = false;
+  ctx->presented = false;
+  #endif
+  ctx->measure_latency = options->latency;
+  ctx->latency_n_pending = 0;
+  memset(ctx->latency_histogram, 0, sizeof(ctx->latency_histogram));
+  ctx->latency_max = 0;
+  ctx->latency_samples = 0;
+  ctx->latency_reported = 0;
+  
+  void *widgets[N_WIDGETS] = {
     NULL, NULL,
     };
   
-  Button *big_button = malloc(sizeof(Button));
-  *big_button = (Button) {win_width/2-19, TOPBAR_HEIGHT/2-19, 38, 38, IMG_BIG_FLAG, 0};
+  Button *big_button = arena_alloc(&ctx->arena, sizeof(Button));
+  *big_button = (Button) {0, TOPBAR_HEIGHT/2-19, 38, 38, IMG_BIG_FLAG, 0};
   widgets[WIDGET_BIG_BUTTON] = big_button;
   
-  NumberDisplay *mine_display = malloc(sizeof(NumberDisplay));
+  NumberDisplay *mine_display = arena_alloc(&ctx->arena, sizeof(NumberDisplay));
   *mine_display = (NumberDisplay) {PADDING+6, PADDING+6, 4, 0};
   widgets[WIDGET_MINE_DISPLAY] = mine_display;
   
-  ctx->widgets = malloc(sizeof(widgets));
+  ctx->widgets = arena_alloc(&ctx->arena, sizeof(widgets));
   memcpy(ctx->widgets, widgets, sizeof(widgets));
   
+  resize_window(ctx);
+  SDL_SetWindowPosition(ctx->window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
+  
+  new_game(ctx, options->seed);
+  if (options->replay) start_replay(ctx, options->replay);
+  if (ctx->resume && saves_ready()) resume_game(ctx);
   SDL_ShowWindow(ctx->window);
   }
 
+#define CONTEXT_MEMORY (arena_size(sizeof(GameContext)) + arena_size(sizeof(SpriteBatch)) + arena_size(sizeof(Button)) \
+  + arena_size(sizeof(NumberDisplay)) + arena_size(sizeof(void *) * N_WIDGETS))
+
+// the context in an arena of its own, destroy_ctx frees both
+GameContext *create_ctx(Options *options) {
+  Arena arena;
+  if (!arena_init(&arena, CONTEXT_MEMORY)) return NULL;
+  GameContext *ctx = arena_alloc(&arena, sizeof(GameContext));
+  ctx->arena = arena;
+  init(ctx, options);
+  return ctx;
+  }
+
+// queues the sprites of a tile drawn at zoom times its size, call flush_batch to draw them
+void draw_tile(SDL_Renderer *renderer, SpriteBatch *batch, Atlas *atlas, Tile t, float screen_x, float screen_y, float zoom) {
+  uint8_t n = TILE_GET_NUMBER(t);
+  float inner_x = screen_x + 3*zoom;
+  float inner_y = screen_y + 3*zoom;
+  PROFILE_COUNT(PROFILE_TILES, 1);
+  
+  if (batch->len > BATCH_MAX-2) flush_batch(renderer, batch, atlas);
+  
+  if (IS_WFLG(t)) {
+    batch_texture(batch, atlas, IMG_TILE_UNKNOWN, screen_x, screen_y, zoom);
+    batch_texture(batch, atlas, IMG_TILE_WFLG, inner_x, inner_y, zoom);
+    }
+  else if (IS_RVLD(t)) {
+    if (IS_MINE(t)) {
+      batch_texture(batch, atlas, IMG_TILE_UNKNOWN, screen_x, screen_y, zoom);
+      batch_texture(batch, atlas, IMG_TILE_MINE, inner_x, inner_y, zoom);
+      }
+    else {
+      batch_texture(batch, atlas, IMG_TILE_OPENED, screen_x, screen_y, zoom);
+      batch_texture(batch, atlas, n, inner_x, inner_y, zoom);
+      }
+    }
+  else {
+    batch_texture(batch, atlas, IMG_TILE_UNKNOWN, screen_x, screen_y, zoom);
+    if (IS_FLAG(t)) {
+      batch_texture(batch, atlas, IMG_TILE_FLAG, inner_x, inner_y, zoom);
+      }
+    }
+  }
+
+// queues a tile of the field at its place in the view
+void draw_field_tile(GameContext *ctx, Tile t, int x, int y) {
+  float tile_size = get_tile_size(ctx);
+  float screen_x = ctx->field_screen_x + x*tile_size - ctx->camera_x;
+  float screen_y = ctx->field_screen_y + y*tile_size - ctx->camera_y;
+  draw_tile(ctx->renderer, ctx->batch, &ctx->atlas, t, screen_x, screen_y, ctx->zoom);
+  }
+
+// tiles at the edge of the view are cut off instead of drawn over the frame
+void clip_to_view(GameContext *ctx) {
+  SDL_RenderSetClipRect(ctx->renderer, &(SDL_Rect) {ctx->field_screen_x, ctx->field_screen_y, ctx->view_w, ctx->view_h});
+  }
+
+// draws the window background and the visible tiles of the field to the current render target
+void draw_board(GameContext *ctx) {
+  SDL_Renderer *renderer = ctx->renderer;
+  Atlas *atlas = &ctx->atlas;
+  
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+  SDL_RenderClear(renderer);
+  PROFILE_COUNT(PROFILE_DRAW_CALLS, 1);
+  
+  // Top Bar
+  draw_rigid_rect(renderer, atlas, IMG_TILE_UNKNOWN, 0, 0, ctx->view_w+PADDING*2+6, ctx->view_h+TOPBAR_HEIGHT+3+PADDING);
+  draw_inset_rect(renderer, atlas, IMG_TILE_INSET, PADDING, PADDING, ctx->view_w+6, TOPBAR_HEIGHT-PADDING*2);
+  draw_inset_rect(renderer, atlas, IMG_TILE_INSET, ctx->field_screen_x-3, ctx->field_screen_y-3, ctx->view_w+6, ctx->view_h+6);
+  
+  // Field, only the visible part so the cost depends on the view and not on the field
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+  SDL_RenderFillRect(renderer, &(SDL_Rect) {ctx->field_screen_x, ctx->field_screen_y, ctx->view_w, ctx->view_h});
+  PROFILE_COUNT(PROFILE_DRAW_CALLS, 1);
+  clip_to_view(ctx);
+  
+  int x0, y0, x1, y1;
+  get_visible_tiles(ctx, &x0, &y0, &x1, &y1);
+  
+  for (int y=y0;y<y1;y++) {
+    for (int x=x0;x<x1;x++) draw_field_tile(ctx, view_tile(ctx, x, y), x, y);
+    }
+  flush_batch(renderer, ctx->batch, atlas);
+  SDL_RenderSetClipRect(renderer, NULL);
+  }
+
+void fill_shade(SDL_Renderer *renderer, SDL_Rect *rects, int *n_rects, int shade) {
+  SDL_SetRenderDrawColor(renderer, 255 * shade / (ODDS_SHADES-1), 255 * (ODDS_SHADES-1 - shade) / (ODDS_SHADES-1), 0, 128);
+  SDL_RenderFillRects(renderer, rects, *n_rects);
+  PROFILE_COUNT(PROFILE_DRAW_CALLS, 1);
+  *n_rects = 0;
+  }
+
+// tints the frontier tiles in the view from green to red by their chance of holding a mine,
+// the first and the last shade are kept for the tiles that are certain
+void draw_odds(GameContext *ctx) {
+  MineField *field = ctx->field;
+  SDL_Renderer *renderer = ctx->renderer;
+  SDL_Rect rects[ODDS_SHADES][ODDS_RECTS];
+  int n_rects[ODDS_SHADES] = {0};
+  float tile_size = get_tile_size(ctx);
+  
+  SDL_LockMutex(ctx->odds_lock);
+  if (ctx->odds_result_width != field->width || ctx->odds_result_height != field->height) {
+    SDL_UnlockMutex(ctx->odds_lock);
+    return;
+    }
+  
+  int x0, y0, x1, y1;
+  get_visible_tiles(ctx, &x0, &y0, &x1, &y1);
+  clip_to_view(ctx);
+  SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+  for (int y=y0;y<y1;y++) {
+    for (int x=x0;x<x1;x++) {
+      float p = ctx->odds_result[TILE_INDEX(field, x, y)];
+      Tile t = get_tile(field, x, y);
+      if (p < 0 || IS_RVLD(t) || IS_FLAG(t)) continue; // the result can be a frame behind the field
+      
+      int shade = p <= 0 ? 0 : p >= 1 ? ODDS_SHADES-1 : 1 + (int) (p * (ODDS_SHADES-2));
+      float screen_x = ctx->field_screen_x + x*tile_size - ctx->camera_x;
+      float screen_y = ctx->field_screen_y + y*tile_size - ctx->camera_y;
+      int left = floor_to_int(screen_x);
+      int top = floor_to_int(screen_y);
+      rects[shade][n_rects[shade]++] = (SDL_Rect) {left, top, floor_to_int(screen_x + tile_size) - left, floor_to_int(screen_y + tile_size) - top};
+      if (n_rects[shade] == ODDS_RECTS) fill_shade(renderer, rects[shade], &n_rects[shade], shade);
+      }
+    }
+  SDL_UnlockMutex(ctx->odds_lock);
+  
+  for (int s=0;s<ODDS_SHADES;s++) {
+    if (n_rects[s] > 0) fill_shade(renderer, rects[s], &n_rects[s], s);
+    }
+  SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+  SDL_RenderSetClipRect(renderer, NULL);
+  }
+
+// --latency measures every click, key press and wheel step from the timestamp SDL gave its event
+// to the return of SDL_RenderPresent with the frame that shows it, in ms as SDL counts them
+void note_input(GameContext *ctx, const SDL_Event *event) {
+  if (event->type != SDL_MOUSEBUTTONDOWN && event->type != SDL_MOUSEBUTTONUP && event->type != SDL_KEYDOWN && event->type != SDL_MOUSEWHEEL) return;
+  if (ctx->latency_n_pending < LATENCY_PENDING) ctx->latency_pending[ctx->latency_n_pending++] = event->common.timestamp;
+  }
+
+// the smallest latency at least percent of the inputs did not exceed
+int latency_percentile(GameContext *ctx, int percent) {
+  int rank = (ctx->latency_samples * percent + 99) / 100;
+  int seen = 0;
+  for (int ms=0;ms<LATENCY_MAX_MS;ms++) {
+    seen += ctx->latency_histogram[ms];
+    if (seen >= rank) return ms;
+    }
+  return ctx->latency_max;
+  }
+
+// percentiles of every input measured so far and a histogram in buckets that double in width
+void report_latency(GameContext *ctx) {
+  printf("input latency of %d inputs: p50 %d ms, p90 %d ms, p99 %d ms, max %u ms\n", ctx->latency_samples,
+    latency_percentile(ctx, 50), latency_percentile(ctx, 90), latency_percentile(ctx, 99), ctx->latency_max);
+  
+  uint32_t buckets[16] = {0};
+  int n_buckets = 0;
+  uint32_t largest = 1;
+  for (int lo=0, hi=1;lo<=LATENCY_MAX_MS;lo=hi, hi*=2) {
+    for (int ms=lo;ms<hi && ms<=LATENCY_MAX_MS;ms++) buckets[n_buckets] += ctx->latency_histogram[ms];
+    if (buckets[n_buckets] > largest) largest = buckets[n_buckets];
+    n_buckets++;
+    }
+  for (int i=0, lo=0, hi=1;i<n_buckets;i++, lo=hi, hi*=2) {
+    char range[24];
+    if (hi > LATENCY_MAX_MS) snprintf(range, sizeof(range), "%d+", lo);
+    else if (hi == lo+1) snprintf(range, sizeof(range), "%d", lo);
+    else snprintf(range, sizeof(range), "%d-%d", lo, hi-1);
+    printf("  %8s ms %6u ", range, buckets[i]);
+    for (uint32_t k=0;k<(buckets[i]*40 + largest-1) / largest;k++) putchar('#');
+    putchar('\n');
+    }
+  fflush(stdout);
+  ctx->latency_reported = ctx->latency_samples;
+  }
+
+// right after a present, every input handled since the last one is on screen now
+void measure_present(GameContext *ctx) {
+  uint32_t now = SDL_GetTicks();
+  for (int i=0;i<ctx->latency_n_pending;i++) {
+    uint32_t ms = now - ctx->latency_pending[i];
+    if (ms > ctx->latency_max) ctx->latency_max = ms;
+    ctx->latency_histogram[ms < LATENCY_MAX_MS ? ms : LATENCY_MAX_MS]++;
+    ctx->latency_samples++;
+    }
+  ctx->latency_n_pending = 0;
+  if (ctx->latency_samples - ctx->latency_reported >= LATENCY_REPORT) report_latency(ctx);
+  }
+
+#ifdef MINES_PROFILE
+#define TRACE_USAGE " [--trace FILE]"
+#define PROFILE_DIGITS 5
+#define PROFILE_ROW_HEIGHT 46
+
+// one row per timer and counter of the last frame over the top left corner of the view, the tile
+// in front of a row tells which one it is: the mine for the whole frame, numbers for the rest in
+// the order of profile.h, timers are in microseconds
+void draw_profile(GameContext *ctx) {
+  int rows = ctx->view_h / PROFILE_ROW_HEIGHT;
+  if (rows < 1) rows = 1;
+  
+  for (int i=0;i<PROFILE_N;i++) {
+    int x = ctx->field_screen_x + (i / rows) * (TILE_SIZE + 23*PROFILE_DIGITS + 10);
+    int y = ctx->field_screen_y + (i % rows) * PROFILE_ROW_HEIGHT;
+    uint64_t value = profile_last[i];
+    if (i < PROFILE_DRAW_CALLS) value /= 1000;
+    if (value > 99999) value = 99999;
+    
+    draw_texture(ctx->renderer, &ctx->atlas, IMG_TILE_OPENED, x, y+11);
+    draw_texture(ctx->renderer, &ctx->atlas, i == PROFILE_FRAME ? IMG_TILE_MINE : i, x+3, y+14);
+    draw_number_display(ctx->renderer, &(NumberDisplay) {x + TILE_SIZE + 2, y, PROFILE_DIGITS, (int) value}, &ctx->atlas);
+    }
+  }
+#else
+#define TRACE_USAGE ""
+#endif
+
 void frame(GameContext *ctx) {
+  // a frame is counted from the first call after a present until the next present,
+  // so the input handled while nothing was drawn counts towards the frame it shows up in
+  #ifdef MINES_PROFILE
+  if (ctx->presented) profile_next_frame();
+  ctx->presented = false;
+  #endif
+  PROFILE_SCOPE(PROFILE_FRAME);
+  
+  finish_generator(ctx, false);
+  
   SDL_Window *window = ctx->window;
   SDL_Renderer *renderer = ctx->renderer;
   
-  SDL_Texture **textures = ctx->textures;
-  const int textures_len = ctx->textures_len;
+  Atlas *atlas = &ctx->atlas;
   
   const int field_screen_x = ctx->field_screen_x;
   const int field_screen_y = ctx->field_screen_y;
@@ -593,169 +1643,316 @@ void frame(GameContext *ctx) {
   NumberDisplay *mine_display = (NumberDisplay *) widgets[WIDGET_MINE_DISPLAY];
   
   SDL_Event event;
-  uint32_t mouse_just_clicked = 0;
+  SDL_Point left_release;
+  bool left_released = false;
   
   int hovered_tile_x, hovered_tile_y;
-  int mouse_x, mouse_y;
-  
-  SDL_GetMouseState(&mouse_x, &mouse_y);
-    
-  hovered_tile_x = (mouse_x-field_screen_x) / TILE_SIZE;
-  hovered_tile_y = (mouse_y-field_screen_y) / TILE_SIZE;
   
+  PROFILE_BEGIN(events_scope, PROFILE_EVENTS);
   while (SDL_PollEvent(&event)) {
+    // the events queued since the last frame are handled where the pointer was when each of them
+    // happened, not where it is now, so fast clicks land on the tiles they were made on
+    if (event.type == SDL_MOUSEMOTION) {
+      ctx->mouse_x = event.motion.x;
+      ctx->mouse_y = event.motion.y;
+      ctx->mouse_buttons = event.motion.state;
+      }
+    if (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP) {
+      ctx->mouse_x = event.button.x;
+      ctx->mouse_y = event.button.y;
+      if (event.type == SDL_MOUSEBUTTONDOWN) ctx->mouse_buttons |= SDL_BUTTON(event.button.button);
+      else ctx->mouse_buttons &= ~SDL_BUTTON(event.button.button);
+      }
+    if (ctx->measure_latency) note_input(ctx, &event);
+    
+    // moving the mouse only shows up on screen while previewing a chord or holding the big button
+    if (event.type != SDL_MOUSEMOTION || ctx->chord || (event.motion.state & SDL_BUTTON_LMASK)) ctx->redraw = true;
+    
     if (event.type == SDL_QUIT) ctx->run = false;
+    if (event.type == SDL_RENDER_TARGETS_RESET || event.type == SDL_RENDER_DEVICE_RESET) ctx->redraw_board = true;
+    
+    // camera
+    float pan_step = PAN_STEP * get_tile_size(ctx);
+    if (event.type == SDL_MOUSEMOTION && ctx->panning) pan_camera(ctx, -event.motion.xrel, -event.motion.yrel);
+    if (event.type == SDL_MOUSEWHEEL && event.wheel.y != 0) {
+      zoom_camera(ctx, event.wheel.y > 0 ? ctx->zoom*ZOOM_STEP : ctx->zoom/ZOOM_STEP, ctx->mouse_x, ctx->mouse_y);
+      }
+    if (event.type == SDL_KEYDOWN) {
+      if (event.key.keysym.sym == SDLK_LEFT)  pan_camera(ctx, -pan_step, 0);
+      if (event.key.keysym.sym == SDLK_RIGHT) pan_camera(ctx, pan_step, 0);
+      if (event.key.keysym.sym == SDLK_UP)    pan_camera(ctx, 0, -pan_step);
+      if (event.key.keysym.sym == SDLK_DOWN)  pan_camera(ctx, 0, pan_step);
+      if (event.key.keysym.sym == SDLK_TAB) ctx->fast_forward = true;
+      }
+    if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_TAB) ctx->fast_forward = false;
+    screen_to_tile(ctx, ctx->mouse_x, ctx->mouse_y, &hovered_tile_x, &hovered_tile_y);
+    
+    if (event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT && SDL_GetKeyboardState(NULL)[SDL_SCANCODE_SPACE]) {
+      ctx->panning = true; // the left button drags the view while space is held
+      continue;
+      }
+    if (event.type == SDL_MOUSEBUTTONUP && event.button.button == SDL_BUTTON_LEFT && ctx->panning) {
+      ctx->panning = false;
+      continue;
+      }
+    
     if (event.type == SDL_MOUSEBUTTONDOWN) {
-      if (IN_FIELD(hovered_tile_x, hovered_tile_y, field)) {
-        if (ctx->game_state == GAME_PLAYING) {
-          const Tile t = field->tiles[hovered_tile_x][hovered_tile_y];
-          if (event.button.button == SDL_BUTTON_LEFT && !IS_RVLD(t)) {
-            if (dig(field, hovered_tile_x, hovered_tile_y)) game_over(ctx);
-            }
-          if (event.button.button == SDL_BUTTON_RIGHT) {
-            if (!IS_RVLD(t)) flip_flag(field, hovered_tile_x, hovered_tile_y);
-            }
-          if (event.button.button == SDL_BUTTON_MIDDLE) ctx->chord = true;
-          }
-        else if (ctx->game_state == GAME_WAITING) start_game(ctx, hovered_tile_x, hovered_tile_y);
-        }
+      if (event.button.button == SDL_BUTTON_LEFT) open_tile(ctx, hovered_tile_x, hovered_tile_y);
+      if (event.button.button == SDL_BUTTON_RIGHT) flag_tile(ctx, hovered_tile_x, hovered_tile_y);
+      if (event.button.button == SDL_BUTTON_MIDDLE && game_state(ctx) == GAME_PLAYING) ctx->chord = true;
       }
     if (event.type == SDL_MOUSEBUTTONUP) {
-      mouse_just_clicked |= event.button.button;
+      if (event.button.button == SDL_BUTTON_LEFT) {
+        left_release = (SDL_Point) {event.button.x, event.button.y};
+        left_released = true;
+        }
       if (event.button.button == SDL_BUTTON_MIDDLE) {
         ctx->chord = false;
-        if (run_chord(field, hovered_tile_x, hovered_tile_y)) game_over(ctx);
+        chord_tile(ctx, hovered_tile_x, hovered_tile_y);
         }
       }
     if (event.type == SDL_KEYDOWN) {
-      if (ctx->game_state == GAME_PLAYING) {
-        if (IN_FIELD(hovered_tile_x, hovered_tile_y, field)) {
-          const Tile t = field->tiles[hovered_tile_x][hovered_tile_y];
-          if (event.key.keysym.sym == SDLK_f) if (dig(field, hovered_tile_x, hovered_tile_y)) game_over(ctx);
-          if (event.key.keysym.sym == SDLK_d && !IS_RVLD(t)) flip_flag(field, hovered_tile_x, hovered_tile_y);
-          if (event.key.keysym.sym == SDLK_g) {
-            if (run_chord(field, hovered_tile_x, hovered_tile_y)) game_over(ctx);
-            }
-          }
+      if (event.key.keysym.sym == SDLK_f) open_tile(ctx, hovered_tile_x, hovered_tile_y);
+      if (event.key.keysym.sym == SDLK_d) flag_tile(ctx, hovered_tile_x, hovered_tile_y);
+      if (event.key.keysym.sym == SDLK_g) chord_tile(ctx, hovered_tile_x, hovered_tile_y);
+      if (event.key.keysym.sym == SDLK_s) export_seed(ctx);
+      if (event.key.keysym.sym == SDLK_n && !ctx->pending) {
+        field->no_guess = !field->no_guess; // applies from the next board
+        update_title(ctx);
+        }
+      if (event.key.keysym.sym >= SDLK_1 && event.key.keysym.sym < SDLK_1+N_PRESETS) {
+        set_preset(ctx, &presets[event.key.keysym.sym - SDLK_1]);
+        field = ctx->field;
         }
-      else if (ctx->game_state == GAME_WAITING && event.key.keysym.sym == SDLK_f) start_game(ctx, hovered_tile_x, hovered_tile_y);
+      if (event.key.keysym.sym == SDLK_e) {
+        ctx->endless_mode = !ctx->endless_mode;
+        new_game(ctx, next_seed(ctx));
+        field = ctx->field;
+        }
+      if (event.key.keysym.sym == SDLK_o) toggle_odds(ctx);
+      if (event.key.keysym.sym == SDLK_z) undo_move(ctx, false);
+      if (event.key.keysym.sym == SDLK_y) undo_move(ctx, true);
+      if (event.key.keysym.sym == SDLK_r) toggle_practice(ctx);
+      #ifdef MINES_PROFILE
+      if (event.key.keysym.sym == SDLK_p) ctx->profile_shown = !ctx->profile_shown;
+      #endif
       }
     }
+  PROFILE_END(events_scope);
   
   if (!ctx->run) return;
-  
-  mine_display->value = field->placed_mines - field->placed_flags;
-  
-  update_button(big_button, mouse_just_clicked);
-  if (BUTTON_IS_CLICKED(big_button)) {
-    ctx->game_state = GAME_WAITING;
-    clear_field(ctx->field);
-    big_button->image = IMG_BIG_FLAG;
-    mine_display->value = get_n_mines();
+  screen_to_tile(ctx, ctx->mouse_x, ctx->mouse_y, &hovered_tile_x, &hovered_tile_y);
+  
+  if (ctx->replaying) run_replay(ctx);
+  if (ctx->resume && saves_ready()) resume_game(ctx);
+  update_button(big_button, ctx->mouse_x, ctx->mouse_y, ctx->mouse_buttons, left_released ? &left_release : NULL);
+  if (BUTTON_IS_CLICKED(big_button)) new_game(ctx, next_seed(ctx));
+  field = ctx->field;
+  
+  // the engine reports what changed, a new game or board sets redraw_board
+  int events = field_events(field);
+  if (events & (FIELD_EVENT_WON | FIELD_EVENT_LOST)) {
+    record_end(ctx);
+    forget_save(ctx);
     }
-  
-  // if (mine_display->value < 0) mine_display->value = 0;
-  
-  if (field->tiles_unopened == field->placed_mines && ctx->game_state == GAME_PLAYING) {
-    ctx->game_state = GAME_WON;
-    big_button->image = IMG_BIG_WON;
-    mine_display->value = get_n_mines();
-    show_all(field, true);
+  if (events & FIELD_EVENT_REWOUND) update_title(ctx);
+  if (field->all_dirty || field->dirty_len > 0) ctx->unsaved = true;
+  autosave(ctx);
+  bool changed = events != 0 || (ctx->endless && ctx->endless->changed);
+  if (changed || ctx->redraw_board) update_widgets(ctx);
+  
+  if (ctx->endless && ctx->endless->changed) ctx->redraw_board = true; // endless games redraw the whole view
+  if (ctx->redraw_board || field->all_dirty || field->dirty_len > 0) ctx->redraw = true;
+  if (ctx->odds_shown) queue_odds(ctx);
+  if (ctx->odds_shown && SDL_AtomicGet(&ctx->odds_ready)) {
+    SDL_AtomicSet(&ctx->odds_ready, 0);
+    ctx->redraw = true;
     }
+  #ifdef MINES_PROFILE
+  if (ctx->profile_shown) ctx->redraw = true; // keeps the numbers current, at least once per IDLE_WAIT_MS
+  #endif
+  if (!ctx->redraw) return;
+  // without vsync the present does not wait, so a frame due sooner than FRAME_MS after the last one
+  // is held back for the main loop to draw when it is due, with the input that came in meanwhile,
+  // the browser already paces the emscripten main loop
+  #ifndef __EMSCRIPTEN__
+  if (!ctx->vsync && SDL_GetTicks() - ctx->last_present < FRAME_MS) return;
+  #endif
+  ctx->redraw = false;
   
   // Draw
-  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-  SDL_RenderClear(renderer);
-  
-  // Top Bar
-  draw_rigid_rect(renderer, textures[11], 0, 0, field->width*TILE_SIZE+PADDING*2+6, field->height*TILE_SIZE+TOPBAR_HEIGHT+3+PADDING);
-  draw_inset_rect(renderer, textures[12], PADDING, PADDING, field->width*TILE_SIZE+6, TOPBAR_HEIGHT-PADDING*2);
-  draw_inset_rect(renderer, textures[12], field_screen_x-3, field_screen_y-3, field->width*TILE_SIZE+6, field->height*TILE_SIZE+6);
-  
-  draw_button(renderer, big_button, textures);
-  draw_number_display(renderer, mine_display, textures);
-  
-  // Field
-  Tile t;
-  int screen_x, screen_y;
-  for (int x=0;x<field->width;x++) {
-    for (int y=0;y<field->height;y++) {
-      if (ctx->game_state == GAME_WAITING) t = TILE0;
-      else t = field->tiles[x][y];
-      uint8_t n = TILE_GET_NUMBER(t);
-      
-      screen_x = x * TILE_SIZE + field_screen_x;
-      screen_y = y * TILE_SIZE + field_screen_y;
-      
-      if (IS_WFLG(t)) {
-        draw_texture(renderer, textures[IMG_TILE_UNKNOWN], screen_x, screen_y);
-        draw_texture(renderer, textures[IMG_TILE_WFLG], screen_x+3, screen_y+3);
-        }
-      else if (IS_RVLD(t)) {
-        if (IS_MINE(t)) {
-          draw_texture(renderer, textures[IMG_TILE_UNKNOWN], screen_x, screen_y);
-          draw_texture(renderer, textures[9], screen_x+3, screen_y+3);
-          }
-        else {
-          draw_texture(renderer, textures[IMG_TILE_OPENED], screen_x, screen_y);
-          draw_texture(renderer, textures[n], screen_x+3, screen_y+3);
-          }
-        }
-      else {
-        draw_texture(renderer, textures[IMG_TILE_UNKNOWN], screen_x, screen_y);
-        if (IS_FLAG(t)) {
-          draw_texture(renderer, textures[IMG_TILE_FLAG], screen_x+3, screen_y+3);
-          }
+  PROFILE_BEGIN(render_scope, PROFILE_RENDER);
+  if (ctx->board) {
+    SDL_SetRenderTarget(renderer, ctx->board);
+    if (ctx->redraw_board || field->all_dirty) draw_board(ctx);
+    else {
+      int x0, y0, x1, y1;
+      get_visible_tiles(ctx, &x0, &y0, &x1, &y1);
+      clip_to_view(ctx);
+      for (int i=0;i<field->dirty_len;i++) {
+        int x = field->dirty[i] % field->stride - 1;
+        int y = field->dirty[i] / field->stride - 1;
+        if (x < x0 || x >= x1 || y < y0 || y >= y1) continue;
+        draw_field_tile(ctx, get_tile(field, x, y), x, y);
         }
+      flush_batch(renderer, ctx->batch, atlas);
+      SDL_RenderSetClipRect(renderer, NULL);
       }
+    SDL_SetRenderTarget(renderer, NULL);
+    SDL_RenderCopy(renderer, ctx->board, NULL, NULL);
+    PROFILE_COUNT(PROFILE_DRAW_CALLS, 1);
     }
+  else draw_board(ctx);
+  
+  ctx->redraw_board = false;
+  field->all_dirty = false;
+  field->dirty_len = 0;
+  if (ctx->endless) endless_trim(ctx->endless);
+  
+  draw_button(renderer, big_button, atlas);
+  draw_number_display(renderer, mine_display, atlas);
   
-  if (ctx->chord) {
+  if (ctx->chord && hovered_tile_x != NO_TILE) {
     Tile t;
+    clip_to_view(ctx);
     for (int i=0;i<18;i+=2) {
       int x = hovered_tile_x + offsets3x3[i];
       int y = hovered_tile_y + offsets3x3[i+1];
       
-      if (!IN_FIELD(x, y, field)) continue;
+      if (!has_tile(ctx, x, y)) continue;
       
-      t = field->tiles[x][y];
+      t = view_tile(ctx, x, y);
       if (IS_RVLD(t)) continue;
       if (IS_FLAG(t)) continue;
       
-      screen_x = x * TILE_SIZE + field_screen_x;
-      screen_y = y * TILE_SIZE + field_screen_y;
-      
-      draw_texture(renderer, textures[IMG_TILE_OPENED], screen_x, screen_y);
+      float tile_size = get_tile_size(ctx);
+      batch_texture(ctx->batch, atlas, IMG_TILE_OPENED, field_screen_x + x*tile_size - ctx->camera_x, field_screen_y + y*tile_size - ctx->camera_y, ctx->zoom);
       }
+    flush_batch(renderer, ctx->batch, atlas);
+    SDL_RenderSetClipRect(renderer, NULL);
     }
   
+  if (ctx->odds_shown && !ctx->endless && field->state == GAME_PLAYING) draw_odds(ctx);
+  
+  #ifdef MINES_PROFILE
+  if (ctx->profile_shown) draw_profile(ctx);
+  #endif
+  PROFILE_END(render_scope);
+  
+  PROFILE_BEGIN(present_scope, PROFILE_PRESENT);
   SDL_RenderPresent(renderer);
+  PROFILE_END(present_scope);
+  ctx->last_present = SDL_GetTicks();
+  if (ctx->latency_n_pending > 0) measure_present(ctx);
+  #ifdef MINES_PROFILE
+  ctx->presented = true;
+  #endif
   }
 
 void destroy_ctx(GameContext *ctx) {
-  for (int i=0;i<ctx->textures_len;i++) SDL_DestroyTexture(ctx->textures[i]);
-  clear_field(ctx->field);
-  free(ctx->field);
+  SDL_DestroyTexture(ctx->atlas.texture);
+  finish_generator(ctx, true);
+  stop_odds(ctx);
+  record_end(ctx);
+  if (ctx->record) fclose(ctx->record);
+  if (ctx->replay.file) fclose(ctx->replay.file);
+  if (ctx->latency_samples > ctx->latency_reported) report_latency(ctx);
+  finish_saver(ctx, true);
+  if (can_save(ctx) && ctx->unsaved) save_snapshot(ctx->field, ctx->save_path);
+  free_snapshot(&ctx->save);
+  free(ctx->save_path);
+  destroy_field(ctx->field);
+  arena_free(&ctx->game_arena);
+  if (ctx->history) destroy_history(ctx->history);
+  if (ctx->endless) destroy_endless(ctx->endless);
+  if (ctx->board) SDL_DestroyTexture(ctx->board);
+  #ifdef MINES_PROFILE
+  profile_close_trace();
+  #endif
   
   SDL_DestroyRenderer(ctx->renderer);
   SDL_DestroyWindow(ctx->window);
   SDL_Quit();
+  
+  Arena arena = ctx->arena; // ctx is in it
+  arena_free(&arena);
   }
 
-int main() {
-  GameContext *ctx = malloc(sizeof(GameContext));
-  init(ctx);
+#ifndef MINES_NO_MAIN // bench.c includes this file for the render benchmarks
+// options that pick the board, the saved game is not continued when one is given
+const char *board_options[] = {"--seed", "--endless", "--replay", "--preset", "--width", "--height", "--mines", "--density"};
+
+int main(int argc, char **argv) {
+  Options options = {0};
+  options.seed = (uint64_t) time(NULL) ^ SDL_GetPerformanceCounter() << 20;
+  options.width = STARTING_FIELD_WIDTH;
+  options.height = STARTING_FIELD_HEIGHT;
+  options.save = true;
+  options.resume = true;
+  double density = STARTING_DENSITY;
+  
+  for (int i=1;i<argc;i++) {
+    const Preset *preset;
+    for (int k=0;k<(int) (sizeof(board_options)/sizeof(board_options[0]));k++) {
+      if (strcmp(argv[i], board_options[k]) == 0) options.resume = false;
+      }
+    if (strcmp(argv[i], "--seed") == 0 && i+1 < argc) options.seed = strtoull(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--no-guess") == 0) options.no_guess = true;
+    else if (strcmp(argv[i], "--endless") == 0) options.endless = true;
+    else if (strcmp(argv[i], "--practice") == 0) options.practice = true;
+    else if (strcmp(argv[i], "--latency") == 0) options.latency = true;
+    else if (strcmp(argv[i], "--record") == 0 && i+1 < argc) options.record = argv[++i];
+    else if (strcmp(argv[i], "--replay") == 0 && i+1 < argc) options.replay = argv[++i];
+    #ifdef MINES_PROFILE
+    else if (strcmp(argv[i], "--trace") == 0 && i+1 < argc) {
+      if (!profile_open_trace(argv[++i])) {
+        fprintf(stderr, "cannot open %s\n", argv[i]);
+        return 1;
+        }
+      }
+    #endif
+    else if (strcmp(argv[i], "--width") == 0 && i+1 < argc) options.width = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--height") == 0 && i+1 < argc) options.height = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--mines") == 0 && i+1 < argc) options.n_mines = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--density") == 0 && i+1 < argc) {
+      density = atof(argv[++i]);
+      options.n_mines = 0;
+      }
+    else if (strcmp(argv[i], "--preset") == 0 && i+1 < argc && (preset = find_preset(argv[i+1]))) {
+      options.width = preset->width;
+      options.height = preset->height;
+      options.n_mines = preset->n_mines;
+      i++;
+      }
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--no-guess] [--practice] [--endless] [--preset beginner|intermediate|expert] [--width W] [--height H] [--mines N | --density D] [--record FILE] [--replay FILE] [--latency]" TRACE_USAGE "\n", argv[0]);
+      return 1;
+      }
+    }
+  
+  if (options.width < MIN_FIELD_WIDTH || options.width > MAX_FIELD_SIZE || options.height < 1 || options.height > MAX_FIELD_SIZE) {
+    fprintf(stderr, "the width must be between %d and %d and the height between 1 and %d\n", MIN_FIELD_WIDTH, MAX_FIELD_SIZE, MAX_FIELD_SIZE);
+    return 1;
+    }
+  options.density = density;
+  if (options.n_mines <= 0) options.n_mines = get_n_mines(options.width, options.height, density);
+  if (options.n_mines >= options.width*options.height) options.n_mines = options.width*options.height-1;
+  
+  GameContext *ctx = create_ctx(&options);
+  if (!ctx) return 1;
   
   #ifdef __EMSCRIPTEN__
   emscripten_set_main_loop_arg((em_arg_callback_func) frame, ctx, 0, 1);
   #else
+  // sleeps until input arrives or a replayed action is due, frame() only renders when something changed
   while (ctx->run) {
+    SDL_WaitEventTimeout(NULL, idle_wait(ctx));
     frame(ctx);
-    // SDL_Delay(1/60);
     }
   
   destroy_ctx(ctx);
   #endif
   
   return 0;
-  }
\ No newline at end of file
+  }
+#endif
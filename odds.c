@@ -0,0 +1,566 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "odds.h"
+
+#define ODDS_INDEX(odds, x, y) (((y)+1) * (odds)->stride + (x)+1)
+
+static const int around[16] = {-1, -1, 0, -1, 1, -1, -1, 0, 1, 0, -1, 1, 0, 1, 1, 1};
+
+static int *push(int *list, int *len, int *capacity, int value) {
+  if (*len == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 64;
+    list = realloc(list, sizeof(int) * *capacity);
+    }
+  list[(*len)++] = value;
+  return list;
+  }
+
+Odds *create_odds(int width, int height, int n_mines) {
+  Odds *odds = calloc(1, sizeof(Odds));
+  int stride = width + 2;
+  int n = stride * (height + 2);
+  
+  odds->width = width;
+  odds->height = height;
+  odds->stride = stride;
+  odds->n_mines = n_mines;
+  odds->view = malloc(n);
+  odds->prob = malloc(sizeof(float) * n);
+  odds->component_of = malloc(sizeof(int) * n);
+  odds->mark = calloc(n, sizeof(int));
+  odds->position = malloc(sizeof(int) * n);
+  
+  for (int i=0;i<n;i++) {
+    int x = i % stride - 1;
+    int y = i / stride - 1;
+    odds->view[i] = x < 0 || x >= width || y < 0 || y >= height ? ODDS_BORDER : ODDS_COVERED;
+    odds->prob[i] = ODDS_NONE;
+    odds->component_of[i] = -1;
+    }
+  for (int k=0;k<8;k++) odds->neighbors[k] = around[k*2+1] * stride + around[k*2];
+  
+  odds->n_covered = width * height;
+  odds->interior = (float) n_mines / (width * height);
+  odds->exact = true;
+  return odds;
+  }
+
+static void free_component(Component *component) {
+  free(component->tiles);
+  free(component->weight);
+  free(component->mine);
+  *component = (Component) {0};
+  }
+
+void destroy_odds(Odds *odds) {
+  for (int c=0;c<odds->n_components;c++) free_component(&odds->components[c]);
+  free(odds->components);
+  free(odds->free_slots);
+  free(odds->view);
+  free(odds->prob);
+  free(odds->changed);
+  free(odds->component_of);
+  free(odds->seeds);
+  free(odds->mark);
+  free(odds->position);
+  free(odds);
+  }
+
+void odds_change(Odds *odds, int x, int y, int value) {
+  int i = ODDS_INDEX(odds, x, y);
+  int old = odds->view[i];
+  if (old == value) return;
+  
+  if (old == ODDS_COVERED) odds->n_covered --;
+  if (old == ODDS_FLAG) odds->n_flags --;
+  if (value == ODDS_COVERED) odds->n_covered ++;
+  if (value == ODDS_FLAG) odds->n_flags ++;
+  odds->view[i] = value;
+  odds->changed = push(odds->changed, &odds->n_changed, &odds->changed_capacity, i);
+  }
+
+float odds_get(Odds *odds, int x, int y) {
+  return odds->prob[ODDS_INDEX(odds, x, y)];
+  }
+
+static bool on_frontier(Odds *odds, int i) {
+  if (odds->view[i] != ODDS_COVERED) return false;
+  for (int k=0;k<8;k++) {
+    if (odds->view[i + odds->neighbors[k]] >= 0) return true;
+    }
+  return false;
+  }
+
+// its tiles go back to the seeds, the next component found from them replaces it
+static void drop_component(Odds *odds, int c) {
+  Component *component = &odds->components[c];
+  for (int t=0;t<component->n_tiles;t++) {
+    int i = component->tiles[t];
+    odds->component_of[i] = -1;
+    odds->prob[i] = ODDS_NONE;
+    odds->seeds = push(odds->seeds, &odds->n_seeds, &odds->seeds_capacity, i);
+    }
+  free_component(component);
+  odds->free_slots = push(odds->free_slots, &odds->n_free, &odds->free_capacity, c);
+  }
+
+static int new_component(Odds *odds) {
+  if (odds->n_free > 0) return odds->free_slots[--odds->n_free];
+  if (odds->n_components == odds->components_capacity) {
+    odds->components_capacity = odds->components_capacity ? odds->components_capacity * 2 : 64;
+    odds->components = realloc(odds->components, sizeof(Component) * odds->components_capacity);
+    }
+  odds->components[odds->n_components] = (Component) {0};
+  return odds->n_components++;
+  }
+
+// a number next to a component and the mines it still needs among its covered neighbors
+typedef struct {
+  int need;
+  int tiles[8]; // positions in the component, ascending
+  int n_tiles;
+  } Constraint;
+
+// the states of the count after the first i tiles of a component: the mines each open
+// constraint still needs, and per state the configurations so far by their number of mines
+typedef struct {
+  int n_states;
+  int capacity;
+  uint8_t *keys; // n_active bytes per state
+  double *f; // i+1 per state, scaled so the largest is 1
+  int *next; // per state and value of tile i, the state after it or -1
+  int lo; // fewest and most mines any state holds
+  int hi;
+  } Step;
+
+static uint32_t hash_key(const uint8_t *key, int len) {
+  uint32_t h = 2166136261u;
+  for (int k=0;k<len;k++) h = (h ^ key[k]) * 16777619u;
+  return h;
+  }
+
+static void free_steps(Step *steps, int n) {
+  for (int i=0;i<=n;i++) {
+    free(steps[i].keys);
+    free(steps[i].f);
+    free(steps[i].next);
+    }
+  free(steps);
+  }
+
+// counts the configurations of a component tile by tile with the constraints that are open at
+// that point as the state, forwards for the weights and backwards for the chance of each tile,
+// leaves weight NULL if a flag contradicts a number or the count outgrows ODDS_MAX_CELLS
+static void count_component(Odds *odds, Component *component) {
+  int n = component->n_tiles;
+  const int *tiles = component->tiles;
+  
+  // the constraints, found through the numbers next to the tiles
+  Constraint *constraints = malloc(sizeof(Constraint) * n * 8);
+  int n_constraints = 0;
+  int (*of_tile)[8] = malloc(sizeof(int[8]) * n);
+  int *n_of_tile = calloc(n, sizeof(int));
+  bool possible = true;
+  
+  odds->stamp ++;
+  for (int p=0;p<n;p++) odds->position[tiles[p]] = p;
+  for (int p=0;p<n;p++) {
+    for (int k=0;k<8;k++) {
+      int number = tiles[p] + odds->neighbors[k];
+      if (odds->view[number] < 0 || odds->mark[number] == odds->stamp) continue;
+      odds->mark[number] = odds->stamp;
+      
+      Constraint *c = &constraints[n_constraints];
+      c->need = odds->view[number];
+      c->n_tiles = 0;
+      for (int j=0;j<8;j++) {
+        int u = number + odds->neighbors[j];
+        if (odds->view[u] == ODDS_FLAG) c->need --;
+        else if (odds->view[u] == ODDS_COVERED) {
+          int q = c->n_tiles++;
+          for (;q>0 && c->tiles[q-1] > odds->position[u];q--) c->tiles[q] = c->tiles[q-1];
+          c->tiles[q] = odds->position[u];
+          }
+        }
+      if (c->need < 0 || c->need > c->n_tiles) possible = false;
+      for (int t=0;t<c->n_tiles;t++) of_tile[c->tiles[t]][n_of_tile[c->tiles[t]]++] = n_constraints;
+      n_constraints ++;
+      }
+    }
+  
+  int *active = malloc(sizeof(int) * n_constraints);
+  int *next_active = malloc(sizeof(int) * n_constraints);
+  int *from = malloc(sizeof(int) * n_constraints);
+  int *slot = malloc(sizeof(int) * n_constraints);
+  int *in_tile = calloc(n_constraints, sizeof(int)); // i+1 while the constraint has tile i
+  int n_active = 0;
+  uint8_t key[256];
+  
+  Step *steps = calloc(n + 1, sizeof(Step));
+  steps[0] = (Step) {1, 1, malloc(1), malloc(sizeof(double)), NULL, 0, 0};
+  steps[0].f[0] = 1;
+  int table_capacity = 0;
+  int *table = NULL;
+  long long cells = 1;
+  
+  int i = 0;
+  for (;possible && i<n;i++) {
+    Step *step = &steps[i];
+    Step *after = &steps[i+1];
+    
+    // the constraints open after tile i: those still open that have tiles after it, then those that start with it
+    for (int a=0;a<n_active;a++) slot[active[a]] = a;
+    int n_next = 0;
+    for (int a=0;a<n_active;a++) {
+      Constraint *c = &constraints[active[a]];
+      if (c->tiles[c->n_tiles-1] > i) {
+        from[n_next] = a;
+        next_active[n_next++] = active[a];
+        }
+      }
+    for (int t=0;t<n_of_tile[i];t++) {
+      int k = of_tile[i][t];
+      in_tile[k] = i + 1;
+      Constraint *c = &constraints[k];
+      if (c->tiles[0] == i && c->tiles[c->n_tiles-1] > i) {
+        from[n_next] = -1;
+        next_active[n_next++] = k;
+        }
+      }
+    if (n_next > (int) sizeof(key)) {
+      possible = false;
+      break;
+      }
+    
+    int left[256]; // tiles after i of each constraint open after it
+    for (int a=0;a<n_next;a++) {
+      Constraint *c = &constraints[next_active[a]];
+      left[a] = 0;
+      for (int t=0;t<c->n_tiles;t++) left[a] += c->tiles[t] > i;
+      }
+    
+    int len = i + 2; // mines so far after tile i, 0 to i+1
+    *after = (Step) {0, 16, malloc(16 * (n_next ? n_next : 1)), malloc(sizeof(double) * 16 * len), NULL, len, -1};
+    step->next = malloc(sizeof(int) * step->n_states * 2);
+    if (table_capacity < 2 * step->n_states || table_capacity < 64) {
+      table_capacity = 64;
+      while (table_capacity < 4 * step->n_states) table_capacity *= 2;
+      table = realloc(table, sizeof(int) * table_capacity);
+      }
+    memset(table, -1, sizeof(int) * table_capacity);
+    
+    for (int s=0;s<step->n_states && possible;s++) {
+      const uint8_t *state = step->keys + s * n_active;
+      for (int x=0;x<2;x++) {
+        step->next[s*2+x] = -1;
+        
+        // the constraints that end with tile i must be met, single tile ones included
+        bool fits = true;
+        for (int t=0;t<n_of_tile[i] && fits;t++) {
+          Constraint *c = &constraints[of_tile[i][t]];
+          if (c->tiles[c->n_tiles-1] != i) continue;
+          int need = c->tiles[0] == i ? c->need : state[slot[of_tile[i][t]]];
+          fits = need == x;
+          }
+        for (int a=0;a<n_next && fits;a++) {
+          int k = next_active[a];
+          int need = (from[a] < 0 ? constraints[k].need : state[from[a]]) - (in_tile[k] == i+1 ? x : 0);
+          fits = need >= 0 && need <= left[a];
+          key[a] = (uint8_t) need;
+          }
+        if (!fits) continue;
+        
+        uint32_t h = hash_key(key, n_next) & (table_capacity - 1);
+        while (table[h] >= 0 && memcmp(after->keys + table[h] * n_next, key, n_next) != 0) h = (h + 1) & (table_capacity - 1);
+        if (table[h] < 0) {
+          if (after->n_states == after->capacity) {
+            after->capacity *= 2;
+            after->keys = realloc(after->keys, after->capacity * (n_next ? n_next : 1));
+            after->f = realloc(after->f, sizeof(double) * after->capacity * len);
+            }
+          if (2 * (after->n_states + 1) > table_capacity) {
+            // rehash the states of this step into a table twice the size
+            table_capacity *= 2;
+            table = realloc(table, sizeof(int) * table_capacity);
+            memset(table, -1, sizeof(int) * table_capacity);
+            for (int o=0;o<after->n_states;o++) {
+              uint32_t g = hash_key(after->keys + o * n_next, n_next) & (table_capacity - 1);
+              while (table[g] >= 0) g = (g + 1) & (table_capacity - 1);
+              table[g] = o;
+              }
+            h = hash_key(key, n_next) & (table_capacity - 1);
+            while (table[h] >= 0) h = (h + 1) & (table_capacity - 1);
+            }
+          table[h] = after->n_states++;
+          memcpy(after->keys + table[h] * n_next, key, n_next);
+          memset(after->f + table[h] * len, 0, sizeof(double) * len);
+          cells += len;
+          if (cells > ODDS_MAX_CELLS) possible = false;
+          }
+        
+        int o = table[h];
+        step->next[s*2+x] = o;
+        double *f = after->f + o * len;
+        for (int m=step->lo;m<=step->hi;m++) f[m+x] += step->f[s * (len-1) + m];
+        if (step->lo + x < after->lo) after->lo = step->lo + x;
+        if (step->hi + x > after->hi) after->hi = step->hi + x;
+        }
+      }
+    
+    if (after->n_states == 0) possible = false;
+    double max = 0;
+    for (int v=0;v<after->n_states * len;v++) if (after->f[v] > max) max = after->f[v];
+    if (max > 0) for (int v=0;v<after->n_states * len;v++) after->f[v] /= max;
+    
+    memcpy(active, next_active, sizeof(int) * n_next);
+    n_active = n_next;
+    }
+  
+  if (possible) {
+    // every constraint is closed after the last tile, which leaves a single state
+    Step *last = &steps[n];
+    component->lo = last->lo;
+    component->hi = last->hi;
+    int range = last->hi - last->lo + 1;
+    component->weight = malloc(sizeof(double) * range);
+    component->mine = malloc(sizeof(double) * range * n);
+    for (int m=0;m<range;m++) component->weight[m] = last->f[last->lo + m];
+    
+    // b holds the configurations of the tiles after i by their number of mines, per state after tile i
+    double *b = malloc(sizeof(double));
+    b[0] = 1;
+    double *t0 = malloc(sizeof(double) * (n + 1));
+    double *t1 = malloc(sizeof(double) * (n + 1));
+    for (i=n-1;i>=0;i--) {
+      Step *step = &steps[i];
+      int len = i + 1;
+      int rest = n - i; // mines after tile i-1, 0 to n-i
+      int rest_after = n - i - 1;
+      double *bi = calloc((size_t) step->n_states * (rest + 1), sizeof(double));
+      memset(t0, 0, sizeof(double) * (n + 1));
+      memset(t1, 0, sizeof(double) * (n + 1));
+      
+      for (int s=0;s<step->n_states;s++) {
+        const double *f = step->f + s * len;
+        for (int x=0;x<2;x++) {
+          int o = step->next[s*2+x];
+          if (o < 0) continue;
+          const double *ba = b + o * (rest_after + 1);
+          double *t = x ? t1 : t0;
+          for (int r=0;r<=rest_after;r++) {
+            if (ba[r] == 0) continue;
+            bi[s * (rest + 1) + r + x] += ba[r];
+            for (int m=step->lo;m<=step->hi;m++) t[m + r + x] += f[m] * ba[r];
+            }
+          }
+        }
+      
+      for (int m=0;m<range;m++) {
+        double all = t0[component->lo + m] + t1[component->lo + m];
+        component->mine[i * range + m] = all > 0 ? t1[component->lo + m] / all : 0;
+        }
+      
+      double max = 0;
+      for (int v=0;v<step->n_states * (rest + 1);v++) if (bi[v] > max) max = bi[v];
+      if (max > 0) for (int v=0;v<step->n_states * (rest + 1);v++) bi[v] /= max;
+      free(b);
+      b = bi;
+      }
+    free(b);
+    free(t0);
+    free(t1);
+    }
+  
+  free_steps(steps, n);
+  free(table);
+  free(constraints);
+  free(of_tile);
+  free(n_of_tile);
+  free(active);
+  free(next_active);
+  free(from);
+  free(slot);
+  free(in_tile);
+  }
+
+// the covered tiles that share a number with the seed, and with those, and so on
+static void find_component(Odds *odds, int seed) {
+  int c = new_component(odds);
+  int len = 0;
+  int capacity = 0;
+  int *tiles = push(NULL, &len, &capacity, seed);
+  odds->component_of[seed] = c;
+  
+  for (int head=0;head<len;head++) {
+    for (int k=0;k<8;k++) {
+      int number = tiles[head] + odds->neighbors[k];
+      if (odds->view[number] < 0) continue;
+      for (int j=0;j<8;j++) {
+        int u = number + odds->neighbors[j];
+        if (odds->view[u] != ODDS_COVERED || odds->component_of[u] == c) continue;
+        if (odds->component_of[u] >= 0) drop_component(odds, odds->component_of[u]); // only if a change was left out
+        odds->component_of[u] = c;
+        tiles = push(tiles, &len, &capacity, u);
+        }
+      }
+    }
+  
+  Component *component = &odds->components[c];
+  component->tiles = tiles;
+  component->n_tiles = len;
+  count_component(odds, component);
+  }
+
+static double log_choose(int n, int k) {
+  return lgamma(n + 1.0) - lgamma(k + 1.0) - lgamma(n - k + 1.0);
+  }
+
+static void normalize(double *v, int len) {
+  double max = 0;
+  for (int k=0;k<len;k++) if (v[k] > max) max = v[k];
+  if (max > 0) for (int k=0;k<len;k++) v[k] /= max;
+  }
+
+// every total of mines on the frontier is weighed by the ways the rest fit into the covered tiles
+// off it. With s the mines of the components before k, above their fewest, h[k](s) weighs the
+// components from k on together with the rest and pre(s) the components before k, so the
+// weight of component k holding m mines is the sum of pre(s) h[k+1](s+m).
+static void combine(Odds *odds) {
+  int *live = malloc(sizeof(int) * (odds->n_components + 1));
+  int n_live = 0;
+  int range = 0; // of the mines of every live component together
+  int fewest = 0;
+  int frontier = 0;
+  
+  for (int c=0;c<odds->n_components;c++) {
+    Component *component = &odds->components[c];
+    if (!component->tiles) continue;
+    frontier += component->n_tiles;
+    if (!component->weight) {
+      odds->exact = false;
+      continue;
+      }
+    live[n_live++] = c;
+    range += component->hi - component->lo;
+    fewest += component->lo;
+    }
+  int rest = odds->n_covered - frontier;
+  int mines = odds->n_mines - odds->n_flags - fewest;
+  
+  // h[k] has before[k]+1 values, before[k] being the range of the components before k
+  int *before = malloc(sizeof(int) * (n_live + 1));
+  size_t *at = malloc(sizeof(size_t) * (n_live + 1));
+  size_t size = 0;
+  for (int k=0;k<=n_live;k++) {
+    before[k] = k ? before[k-1] + odds->components[live[k-1]].hi - odds->components[live[k-1]].lo : 0;
+    at[k] = size;
+    size += before[k] + 1;
+    }
+  double *h = malloc(sizeof(double) * size);
+  
+  double *g = h + at[n_live];
+  double top = -INFINITY;
+  for (int s=0;s<=range;s++) {
+    int k = mines - s;
+    g[s] = k >= 0 && k <= rest ? log_choose(rest, k) : -INFINITY;
+    if (g[s] > top) top = g[s];
+    }
+  for (int s=0;s<=range;s++) g[s] = top > -INFINITY ? exp(g[s] - top) : 0;
+  
+  for (int k=n_live-1;k>=0;k--) {
+    Component *component = &odds->components[live[k]];
+    double *hk = h + at[k];
+    const double *hn = h + at[k+1];
+    for (int s=0;s<=before[k];s++) {
+      double v = 0;
+      for (int m=0;m<=component->hi - component->lo;m++) v += component->weight[m] * hn[s + m];
+      hk[s] = v;
+      }
+    normalize(hk, before[k] + 1);
+    }
+  
+  double *pre = calloc(range + 1, sizeof(double));
+  double *pre_next = calloc(range + 1, sizeof(double));
+  double *total = malloc(sizeof(double) * (range + 1));
+  pre[0] = 1;
+  for (int k=0;k<n_live;k++) {
+    Component *component = &odds->components[live[k]];
+    int m_range = component->hi - component->lo + 1;
+    const double *hn = h + at[k+1];
+    
+    double z = 0;
+    for (int m=0;m<m_range;m++) {
+      double v = 0;
+      for (int s=0;s<=before[k];s++) v += pre[s] * hn[s + m];
+      total[m] = component->weight[m] * v;
+      z += total[m];
+      }
+    for (int t=0;t<component->n_tiles;t++) {
+      double p = 0;
+      for (int m=0;m<m_range;m++) p += total[m] * component->mine[t * m_range + m];
+      odds->prob[component->tiles[t]] = z > 0 ? (float) (p / z) : ODDS_NONE;
+      }
+    if (z <= 0) odds->exact = false;
+    
+    memset(pre_next, 0, sizeof(double) * (before[k+1] + 1));
+    for (int s=0;s<=before[k];s++) {
+      for (int m=0;m<m_range;m++) pre_next[s + m] += pre[s] * component->weight[m];
+      }
+    normalize(pre_next, before[k+1] + 1);
+    double *swap = pre;
+    pre = pre_next;
+    pre_next = swap;
+    }
+  
+  // the expected mines off the frontier
+  double z = 0;
+  double expected = 0;
+  for (int s=0;s<=range;s++) {
+    z += pre[s] * g[s];
+    expected += pre[s] * g[s] * (mines - s);
+    }
+  odds->interior = rest > 0 && z > 0 ? (float) (expected / z / rest) : ODDS_NONE;
+  if (z <= 0) odds->exact = false;
+  
+  free(live);
+  free(before);
+  free(at);
+  free(h);
+  free(pre);
+  free(pre_next);
+  free(total);
+  }
+
+void odds_compute(Odds *odds) {
+  // the components within two tiles of a change are dropped, since one of their numbers may
+  // have changed, and new ones are looked for from their tiles and the tiles around the changes
+  odds->stamp ++;
+  for (int c=0;c<odds->n_changed;c++) {
+    int i = odds->changed[c];
+    int x = i % odds->stride - 1;
+    int y = i / odds->stride - 1;
+    odds->prob[i] = ODDS_NONE;
+    for (int dy=-2;dy<=2;dy++) {
+      for (int dx=-2;dx<=2;dx++) {
+        if (x+dx < 0 || x+dx >= odds->width || y+dy < 0 || y+dy >= odds->height) continue;
+        int j = i + dy * odds->stride + dx;
+        if (odds->component_of[j] >= 0) drop_component(odds, odds->component_of[j]);
+        if (odds->mark[j] == odds->stamp) continue;
+        odds->mark[j] = odds->stamp;
+        odds->seeds = push(odds->seeds, &odds->n_seeds, &odds->seeds_capacity, j);
+        }
+      }
+    }
+  odds->n_changed = 0;
+  
+  for (int s=0;s<odds->n_seeds;s++) {
+    int i = odds->seeds[s];
+    if (odds->component_of[i] < 0 && on_frontier(odds, i)) find_component(odds, i);
+    }
+  odds->n_seeds = 0;
+  
+  odds->exact = true;
+  combine(odds);
+  }
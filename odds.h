@@ -0,0 +1,88 @@
+/*
+  Exact mine probabilities of the covered tiles, from what the player sees: the revealed
+  numbers, the flags (taken to be right) and the number of mines of the board.
+  
+  The covered tiles next to a number form the frontier, it splits into components that share
+  no number. The configurations of a component are counted once, per number of mines it holds,
+  and kept until a change within two tiles of it, so a click only recounts the components it
+  touched. Combining them with the rest of the board weighs every total by the ways the
+  remaining mines fit into the covered tiles away from the frontier.
+  
+  Nothing here reads a MineField, the caller passes the changes in, so the counting can run
+  on another thread than the game.
+  
+  Typical use:
+    Odds *odds = create_odds(width, height, n_mines);
+    odds_change(odds, x, y, ODDS_FLAG);  // or ODDS_COVERED, or the number of a revealed tile
+    odds_compute(odds);
+    float p = odds_get(odds, x, y);  // ODDS_NONE away from the frontier, see odds->interior
+    destroy_odds(odds);
+*/
+
+#ifndef ODDS_H
+#define ODDS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// odds->view
+#define ODDS_COVERED -1
+#define ODDS_FLAG    -2
+#define ODDS_BORDER  -3
+
+#define ODDS_NONE -1.0f // probability of a tile that is not on the frontier or could not be counted
+
+#define ODDS_MAX_CELLS (1 << 22) // doubles a component may take to count, larger ones are given up
+
+typedef struct {
+  int *tiles; // in the order they were counted in
+  int n_tiles;
+  int lo; // fewest and most mines it can hold
+  int hi;
+  double *weight; // configurations with lo + m mines, scaled so the largest is 1
+  double *mine; // n_tiles rows of hi-lo+1, chance of the tile being a mine in those configurations
+  } Component;
+
+typedef struct {
+  int width;
+  int height;
+  int stride; // width + 2, tiles are indexed like those of a MineField
+  int n_mines;
+  int8_t *view; // what the player sees, ODDS_* or the number of a revealed tile
+  float *prob; // the last result of odds_compute per tile
+  float interior; // of every covered tile that is not on the frontier, ODDS_NONE if there is none
+  bool exact; // no component was too large to count or contradicted by a flag
+  
+  int neighbors[8]; // index offsets of the 8 neighbors of a tile
+  int n_covered; // covered tiles without a flag
+  int n_flags;
+  
+  int *changed; // tiles changed since the last odds_compute
+  int n_changed;
+  int changed_capacity;
+  
+  int *component_of; // index into components, -1 off the frontier
+  Component *components; // a free slot has no tiles
+  int n_components;
+  int components_capacity;
+  int *free_slots;
+  int n_free;
+  int free_capacity;
+  
+  // scratch space of odds_compute
+  int *seeds; // tiles a component may have to be found from
+  int n_seeds;
+  int seeds_capacity;
+  int *mark; // per tile, equal to stamp if the tile was seen in the current pass
+  int stamp;
+  int *position; // per tile, its place in the component being counted
+  } Odds;
+
+Odds *create_odds(int width, int height, int n_mines); // every tile covered
+void destroy_odds(Odds *odds);
+
+void odds_change(Odds *odds, int x, int y, int value);
+void odds_compute(Odds *odds);
+float odds_get(Odds *odds, int x, int y);
+
+#endif
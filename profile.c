@@ -0,0 +1,64 @@
+#ifdef MINES_PROFILE
+
+#include <stdio.h>
+#include <time.h>
+
+#include "profile.h"
+
+static const char *names[PROFILE_N] = {"frame", "events", "dig", "chord", "generate", "render", "present", "draw_calls", "tiles"};
+
+// the board generator runs on its own thread, so the totals are added atomically
+static uint64_t totals[PROFILE_N];
+uint64_t profile_last[PROFILE_N];
+
+static FILE *trace;
+static uint64_t trace_start;
+static int n_threads;
+static _Thread_local int thread_id; // 0 until the thread writes its first event
+
+uint64_t profile_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  }
+
+void profile_end(ProfileScope *scope) {
+  uint64_t end = profile_now();
+  __atomic_fetch_add(&totals[scope->zone], end - scope->start, __ATOMIC_RELAXED);
+  if (!trace) return;
+  
+  if (!thread_id) thread_id = __atomic_add_fetch(&n_threads, 1, __ATOMIC_RELAXED);
+  fprintf(trace, "{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d},\n",
+    names[scope->zone], (scope->start - trace_start) / 1e3, (end - scope->start) / 1e3, thread_id);
+  }
+
+void profile_count(int counter, uint64_t n) {
+  __atomic_fetch_add(&totals[counter], n, __ATOMIC_RELAXED);
+  }
+
+void profile_next_frame(void) {
+  for (int i=0;i<PROFILE_N;i++) profile_last[i] = __atomic_exchange_n(&totals[i], 0, __ATOMIC_RELAXED);
+  if (!trace) return;
+  fprintf(trace, "{\"name\": \"per frame\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, \"args\": {\"%s\": %llu, \"%s\": %llu}},\n",
+    (profile_now() - trace_start) / 1e3, names[PROFILE_DRAW_CALLS], (unsigned long long) profile_last[PROFILE_DRAW_CALLS],
+    names[PROFILE_TILES], (unsigned long long) profile_last[PROFILE_TILES]);
+  }
+
+// the events go out as they happen in the JSON array format, whose closing bracket the
+// viewers do not need, so a trace cut short by a crash still loads
+bool profile_open_trace(const char *path) {
+  trace = fopen(path, "w");
+  if (!trace) return false;
+  trace_start = profile_now();
+  fprintf(trace, "[\n");
+  return true;
+  }
+
+void profile_close_trace(void) {
+  if (!trace) return;
+  fprintf(trace, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"mines\"}}\n]\n");
+  fclose(trace);
+  trace = NULL;
+  }
+
+#endif
@@ -0,0 +1,69 @@
+/*
+  Optional instrumentation of the hot paths: timers, per frame counters and a trace file.
+  Compiled in with -DMINES_PROFILE (and profile.c), otherwise every macro is empty.
+  
+  Typical use:
+    PROFILE_SCOPE(PROFILE_DIG);  // times the rest of the enclosing block
+    PROFILE_BEGIN(events, PROFILE_EVENTS);  // or explicitly, around code with no early return
+    PROFILE_END(events);
+    PROFILE_COUNT(PROFILE_TILES, 1);
+    profile_next_frame();  // once per frame, moves the totals since the last call to profile_last
+  
+  Scopes may nest and run on any thread. While a trace is open every scope is also written
+  to it as a Chrome trace event, for chrome://tracing or https://ui.perfetto.dev.
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// timers, in ns
+#define PROFILE_FRAME    0
+#define PROFILE_EVENTS   1
+#define PROFILE_DIG      2
+#define PROFILE_CHORD    3
+#define PROFILE_GENERATE 4
+#define PROFILE_RENDER   5 // drawing into the board and the window, without the present
+#define PROFILE_PRESENT  6
+
+// counters
+#define PROFILE_DRAW_CALLS 7
+#define PROFILE_TILES      8
+
+#define PROFILE_N 9
+
+#ifdef MINES_PROFILE
+
+typedef struct {
+  int zone;
+  uint64_t start;
+  } ProfileScope;
+
+extern uint64_t profile_last[PROFILE_N]; // totals of the last finished frame
+
+uint64_t profile_now(void);
+void profile_end(ProfileScope *scope);
+void profile_count(int counter, uint64_t n);
+void profile_next_frame(void);
+bool profile_open_trace(const char *path);
+void profile_close_trace(void);
+
+#define PROFILE_JOIN(a, b) a##b
+#define PROFILE_NAME(line) PROFILE_JOIN(profile_scope_, line)
+#define PROFILE_SCOPE(zone) ProfileScope PROFILE_NAME(__LINE__) __attribute__((cleanup(profile_end))) = {zone, profile_now()}
+#define PROFILE_BEGIN(name, zone) ProfileScope name = {zone, profile_now()}
+#define PROFILE_END(name) profile_end(&name)
+#define PROFILE_COUNT(counter, n) profile_count(counter, n)
+
+#else
+
+#define PROFILE_SCOPE(zone)
+#define PROFILE_BEGIN(name, zone)
+#define PROFILE_END(name)
+#define PROFILE_COUNT(counter, n)
+
+#endif
+
+#endif
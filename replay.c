@@ -0,0 +1,150 @@
+#include "replay.h"
+
+static const uint8_t magic[2] = {'M', 'R'};
+
+static void write_varint(FILE *file, uint64_t v) {
+  uint8_t bytes[10];
+  int n = 0;
+  do {
+    bytes[n] = v & 127;
+    v >>= 7;
+    if (v) bytes[n] |= 128;
+    n ++;
+    } while (v);
+  fwrite(bytes, 1, n, file);
+  }
+
+static bool read_varint(FILE *file, uint64_t *v) {
+  *v = 0;
+  for (int shift=0;shift<64;shift+=7) {
+    int c = getc(file);
+    if (c == EOF) return false;
+    *v |= (uint64_t) (c & 127) << shift;
+    if (!(c & 128)) return true;
+    }
+  return false;
+  }
+
+// small negative deltas stay small
+static uint64_t zigzag(int v) {
+  return (uint32_t) ((uint32_t) v << 1 ^ (uint32_t) (v >> 31));
+  }
+
+static int unzigzag(uint64_t v) {
+  return (int) (uint32_t) (v >> 1) ^ -(int) (v & 1);
+  }
+
+static void write_header(ReplayWriter *writer, MineField *field) {
+  fwrite(magic, 1, 2, writer->file);
+  fputc(REPLAY_VERSION, writer->file);
+  write_varint(writer->file, field->seed);
+  write_varint(writer->file, field->width);
+  write_varint(writer->file, field->height);
+  write_varint(writer->file, field->n_mines);
+  write_varint(writer->file, (field->no_guess ? REPLAY_NO_GUESS : 0) | (field->packed ? REPLAY_PACKED : 0));
+  write_varint(writer->file, field->no_guess_attempts);
+  }
+
+void replay_record(ReplayWriter *writer, FILE *file, MineField *field, uint32_t tick, int action, int x, int y) {
+  if (!writer->started) {
+    writer->file = file;
+    writer->started = true;
+    writer->tick = 0;
+    writer->x = 0;
+    writer->y = 0;
+    write_header(writer, field);
+    }
+  
+  write_varint(writer->file, (uint64_t) (tick - writer->tick) << 2 | action);
+  write_varint(writer->file, zigzag(x - writer->x));
+  write_varint(writer->file, zigzag(y - writer->y));
+  writer->tick = tick;
+  writer->x = x;
+  writer->y = y;
+  }
+
+void replay_end(ReplayWriter *writer, uint32_t tick, int state) {
+  if (!writer->started) return;
+  write_varint(writer->file, (uint64_t) (tick - writer->tick) << 2 | REPLAY_END);
+  write_varint(writer->file, state);
+  fflush(writer->file);
+  writer->started = false;
+  }
+
+bool replay_next_game(ReplayReader *reader) {
+  // skips what is left of a game the caller did not read to the end
+  ReplayAction action;
+  while (reader->in_game && replay_next_action(reader, &action));
+  
+  uint8_t head[3];
+  if (fread(head, 1, 3, reader->file) != 3) return false;
+  if (head[0] != magic[0] || head[1] != magic[1] || head[2] != REPLAY_VERSION) return false;
+  
+  uint64_t v[6];
+  for (int i=0;i<6;i++) {
+    if (!read_varint(reader->file, &v[i])) return false;
+    }
+  if (v[1] < 1 || v[1] > REPLAY_MAX_SIZE || v[2] < 1 || v[2] > REPLAY_MAX_SIZE) return false;
+  if (!field_size_fits((int) v[1], (int) v[2])) return false; // no field this large could play it
+  if (v[3] >= v[1] * v[2] || v[5] > INT32_MAX) return false;
+  
+  reader->header = (ReplayHeader) {v[0], (int) v[1], (int) v[2], (int) v[3], (int) v[4], (int) v[5]};
+  reader->in_game = true;
+  reader->tick = 0;
+  reader->x = 0;
+  reader->y = 0;
+  return true;
+  }
+
+bool replay_next_action(ReplayReader *reader, ReplayAction *action) {
+  if (!reader->in_game) return false;
+  reader->in_game = false; // until the record is read whole
+  
+  uint64_t v, dx, dy;
+  if (!read_varint(reader->file, &v)) return false;
+  reader->tick += (uint32_t) (v >> 2);
+  action->tick = reader->tick;
+  action->action = v & 3;
+  
+  if (action->action == REPLAY_END) {
+    if (!read_varint(reader->file, &v)) return false;
+    action->x = reader->x;
+    action->y = reader->y;
+    action->state = (int) v;
+    return true;
+    }
+  
+  if (!read_varint(reader->file, &dx) || !read_varint(reader->file, &dy)) return false;
+  reader->x += unzigzag(dx);
+  reader->y += unzigzag(dy);
+  action->x = reader->x;
+  action->y = reader->y;
+  action->state = GAME_PLAYING;
+  reader->in_game = true;
+  return true;
+  }
+
+MineField *replay_create_field(const ReplayHeader *header, Arena *arena) {
+  // the layouts place their mines differently, so a packed recording only plays on a packed field
+  MineField *field = NULL;
+  if (header->flags & REPLAY_PACKED) field = create_packed_field(header->width, header->height, header->n_mines);
+  else {
+    if (arena) field = create_field_in(arena, header->width, header->height, header->n_mines);
+    if (!field) field = create_field(header->width, header->height, header->n_mines);
+    }
+  if (!field) return NULL;
+  
+  set_field_seed(field, header->seed);
+  field->no_guess = header->flags & REPLAY_NO_GUESS;
+  field->no_guess_fixed_attempts = header->attempts;
+  return field;
+  }
+
+int replay_apply(MineField *field, const ReplayAction *action) {
+  switch (action->action) {
+    case REPLAY_OPEN:  return field_open(field, action->x, action->y);
+    case REPLAY_FLAG:  return field_flag(field, action->x, action->y);
+    case REPLAY_CHORD: return field_chord(field, action->x, action->y);
+    default:           return field_state(field);
+    }
+  }
@@ -0,0 +1,91 @@
+/*
+  Game recordings: the board parameters and every action with the time it happened.
+  
+  A stream holds any number of games one after another, each one is a header followed by
+  action records and an end record. Everything is a varint, an action takes a few bytes:
+  (time since the last record << 2 | action), then x and y as zigzag deltas from the last action.
+    
+    header  'M' 'R' version, seed, width, height, mines, flags (1 no guess, 2 packed), no guess attempts
+    action  ticks << 2 | REPLAY_OPEN, REPLAY_FLAG or REPLAY_CHORD, dx, dy
+    end     ticks << 2 | REPLAY_END, final state
+  
+  Ticks are milliseconds since the game was started. The header is written with the first action,
+  once the board exists, so a no guess board can be generated again with the same number of attempts.
+  
+  Typical use:
+    ReplayWriter writer = {0};
+    replay_record(&writer, file, field, ticks, REPLAY_OPEN, x, y);  // after field_open(field, x, y)
+    replay_end(&writer, ticks, field_state(field));
+    
+    ReplayReader reader = {.file = file};
+    while (replay_next_game(&reader)) {
+      MineField *field = replay_create_field(&reader.header, NULL);
+      ReplayAction action;
+      while (replay_next_action(&reader, &action)) replay_apply(field, &action);
+      destroy_field(field);
+      }
+*/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include "minefield.h"
+
+#define REPLAY_VERSION 1
+
+#define REPLAY_OPEN  0
+#define REPLAY_FLAG  1
+#define REPLAY_CHORD 2
+#define REPLAY_END   3
+
+#define REPLAY_NO_GUESS 1
+#define REPLAY_PACKED   2
+
+#define REPLAY_MAX_SIZE 65536 // longest side a header may give, anything larger is a broken stream
+
+typedef struct {
+  uint64_t seed;
+  int width;
+  int height;
+  int n_mines;
+  int flags;
+  int attempts;
+  } ReplayHeader;
+
+typedef struct {
+  uint32_t tick;
+  int action;
+  int x;
+  int y;
+  int state; // the state the recording ended in, for REPLAY_END
+  } ReplayAction;
+
+typedef struct {
+  FILE *file;
+  bool started; // the header of the current game is written
+  uint32_t tick;
+  int x;
+  int y;
+  } ReplayWriter;
+
+typedef struct {
+  FILE *file;
+  ReplayHeader header;
+  bool in_game;
+  uint32_t tick;
+  int x;
+  int y;
+  } ReplayReader;
+
+// recording, from the first action of a game that the game did not ignore
+void replay_record(ReplayWriter *writer, FILE *file, MineField *field, uint32_t tick, int action, int x, int y);
+void replay_end(ReplayWriter *writer, uint32_t tick, int state); // does nothing if the game has no actions
+
+// playback
+bool replay_next_game(ReplayReader *reader); // reads the next header, false at the end of the stream or if it is broken
+bool replay_next_action(ReplayReader *reader, ReplayAction *action); // the end record included, then false
+MineField *replay_create_field(const ReplayHeader *header, Arena *arena); // in the arena if it fits, packed fields never are, NULL without memory
+int replay_apply(MineField *field, const ReplayAction *action); // returns the game state
+
+#endif
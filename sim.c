@@ -0,0 +1,383 @@
+/*
+  Plays seeded games headlessly with the solver and prints statistics, for tuning board generation.
+  
+  gcc -O2 -pthread sim.c minefield.c solver.c replay.c -o sim
+  
+  ./sim [--games N] [--threads N] [--width W] [--height H] [--mines N | --density D]
+        [--seed S] [--no-guess] [--random-opening] [--json]
+  ./sim --verify FILE [--json]
+  
+  Game i is played on seed S+i: the first click goes to the center (or a random tile), then the
+  solver makes every certain move and opens a random covered tile when it is stuck. The guesses
+  come from a generator of the game's own, so the results do not depend on the thread count,
+  except for no guess boards that ran out of time.
+  Prints a summary and histograms of the guesses, 3BV and clicks per game, as CSV or JSON lines.
+  
+  --verify plays the games of a recording (see replay.h) as fast as possible instead and prints
+  one row per game with the state it ends in, the exit status is 1 if any game does not end
+  the way the recording says.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "minefield.h"
+#include "solver.h"
+#include "replay.h"
+
+#define GAMES_PER_TAKE 16 // games a worker takes from its range at a time
+#define MAX_THREADS 256
+#define MAX_BUCKETS 4096 // per histogram, 3BV and clicks of larger boards can go far beyond it
+
+#define HIST_GUESSES 0
+#define HIST_BBBV    1
+#define HIST_CLICKS  2
+#define N_HISTOGRAMS 3
+
+const char *histogram_names[N_HISTOGRAMS] = {"guesses", "3bv", "clicks"};
+
+typedef struct {
+  long long games;
+  int threads;
+  int width;
+  int height;
+  int n_mines;
+  uint64_t seed;
+  bool no_guess;
+  bool random_opening;
+  bool json;
+  const char *verify; // recording to play back instead
+  } SimOptions;
+
+typedef struct {
+  long long games;
+  long long won;
+  long long guesses;
+  long long bbbv;
+  long long clicks;
+  int n_buckets; // per histogram, the last bucket also holds everything above it
+  long long *histograms;
+  } Stats;
+
+// a worker plays the games of its range and steals half of another range when it runs out,
+// it owns its field, in an arena of its own, and its statistics, so a game does not allocate or share anything
+typedef struct Worker {
+  pthread_t thread;
+  pthread_mutex_t lock; // guards next and end
+  long long next;
+  long long end;
+  
+  struct Worker *workers;
+  int id;
+  const SimOptions *options;
+  Stats stats;
+  } Worker;
+
+long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+
+bool init_stats(Stats *stats, int n_buckets) {
+  memset(stats, 0, sizeof(Stats));
+  stats->n_buckets = n_buckets;
+  stats->histograms = calloc((size_t) n_buckets * N_HISTOGRAMS, sizeof(long long));
+  return stats->histograms != NULL;
+  }
+
+void add_to_histogram(Stats *stats, int histogram, int value) {
+  if (value >= stats->n_buckets) value = stats->n_buckets-1;
+  stats->histograms[histogram * stats->n_buckets + value] ++;
+  }
+
+void merge_stats(Stats *into, const Stats *from) {
+  into->games += from->games;
+  into->won += from->won;
+  into->guesses += from->guesses;
+  into->bbbv += from->bbbv;
+  into->clicks += from->clicks;
+  for (int i=0;i<from->n_buckets*N_HISTOGRAMS;i++) into->histograms[i] += from->histograms[i];
+  }
+
+// plays one game to the end, the field is reused from the previous game
+void play_game(MineField *field, const SimOptions *options, long long game, Stats *stats) {
+  int width = field->width;
+  int height = field->height;
+  
+  clear_field(field);
+  field->no_guess = options->no_guess;
+  set_field_seed(field, options->seed + game);
+  Rng rng;
+  rng_seed(&rng, ~(options->seed + game)); // not the stream the board comes from
+  
+  int x = width/2;
+  int y = height/2;
+  if (options->random_opening) {
+    x = rng_range(&rng, width);
+    y = rng_range(&rng, height);
+    }
+  
+  int state = field_open(field, x, y);
+  int guesses = 0;
+  int clicks = 1;
+  while (state == GAME_PLAYING) {
+    // the solver only makes certain moves, which go around the game functions
+    int moves = solver_step(field);
+    if (moves > 0) {
+      clicks += moves;
+      if (field->tiles_unopened == field->placed_mines) state = GAME_WON;
+      continue;
+      }
+    
+    // every covered tile without a flag is a candidate, the solver's flags are all right
+    Tile t;
+    do {
+      x = rng_range(&rng, width);
+      y = rng_range(&rng, height);
+      t = get_tile(field, x, y);
+      } while (IS_RVLD(t) || IS_FLAG(t));
+    guesses ++;
+    clicks ++;
+    state = field_open(field, x, y);
+    }
+  
+  stats->games ++;
+  if (state == GAME_WON) stats->won ++;
+  stats->guesses += guesses;
+  stats->bbbv += field->bbbv;
+  stats->clicks += clicks;
+  add_to_histogram(stats, HIST_GUESSES, guesses);
+  add_to_histogram(stats, HIST_BBBV, field->bbbv);
+  add_to_histogram(stats, HIST_CLICKS, clicks);
+  }
+
+// takes the next games of the worker's own range, or else steals some
+bool take_games(Worker *worker, long long *from, long long *to) {
+  pthread_mutex_lock(&worker->lock);
+  if (worker->next < worker->end) {
+    *from = worker->next;
+    *to = worker->next + GAMES_PER_TAKE < worker->end ? worker->next + GAMES_PER_TAKE : worker->end;
+    worker->next = *to;
+    pthread_mutex_unlock(&worker->lock);
+    return true;
+    }
+  pthread_mutex_unlock(&worker->lock);
+  
+  // the first other worker with games left gives up the second half of them
+  int n_workers = worker->options->threads;
+  for (int k=1;k<n_workers;k++) {
+    Worker *victim = &worker->workers[(worker->id + k) % n_workers];
+    pthread_mutex_lock(&victim->lock);
+    long long left = victim->end - victim->next;
+    long long start = victim->next + left/2;
+    long long end = victim->end;
+    if (left > 0) victim->end = start;
+    pthread_mutex_unlock(&victim->lock);
+    if (left <= 0) continue;
+    
+    // keeps the first games of the stolen half, the rest can be stolen in turn
+    *from = start;
+    *to = start + GAMES_PER_TAKE < end ? start + GAMES_PER_TAKE : end;
+    pthread_mutex_lock(&worker->lock);
+    worker->next = *to;
+    worker->end = end;
+    pthread_mutex_unlock(&worker->lock);
+    return true;
+    }
+  return false;
+  }
+
+void *run_worker(void *data) {
+  Worker *worker = data;
+  const SimOptions *options = worker->options;
+  Arena arena;
+  MineField *field = NULL;
+  if (arena_init(&arena, field_memory(options->width, options->height))) {
+    field = create_field_in(&arena, options->width, options->height, options->n_mines);
+    }
+  if (!field) {
+    // without memory for its field it plays nothing, the others steal its range
+    arena_free(&arena);
+    return NULL;
+    }
+  
+  long long from, to;
+  while (take_games(worker, &from, &to)) {
+    for (long long game=from;game<to;game++) play_game(field, options, game, &worker->stats);
+    }
+  
+  arena_free(&arena);
+  return NULL;
+  }
+
+void print_results(const SimOptions *options, const Stats *stats, long long ns) {
+  double games = stats->games > 0 ? stats->games : 1;
+  double games_per_s = stats->games / (ns / 1e9);
+  
+  if (options->json) {
+    printf("{\"games\": %lld, \"won\": %lld, \"win_rate\": %.6f, \"mean_guesses\": %.4f, \"mean_3bv\": %.4f, \"mean_clicks\": %.4f, \"games_per_s\": %.0f}\n",
+      stats->games, stats->won, stats->won / games, stats->guesses / games, stats->bbbv / games, stats->clicks / games, games_per_s);
+    }
+  else {
+    printf("games,won,win_rate,mean_guesses,mean_3bv,mean_clicks,games_per_s\n");
+    printf("%lld,%lld,%.6f,%.4f,%.4f,%.4f,%.0f\n",
+      stats->games, stats->won, stats->won / games, stats->guesses / games, stats->bbbv / games, stats->clicks / games, games_per_s);
+    printf("histogram,value,games\n");
+    }
+  
+  for (int h=0;h<N_HISTOGRAMS;h++) {
+    for (int v=0;v<stats->n_buckets;v++) {
+      long long n = stats->histograms[h * stats->n_buckets + v];
+      if (n == 0) continue;
+      if (options->json) printf("{\"histogram\": \"%s\", \"value\": %d, \"games\": %lld}\n", histogram_names[h], v, n);
+      else printf("%s,%d,%lld\n", histogram_names[h], v, n);
+      }
+    }
+  }
+
+// plays every game of a recording and checks that it ends the way the recording says,
+// returns the number of games that do not
+long long verify_replays(const SimOptions *options, FILE *file) {
+  ReplayReader reader = {.file = file};
+  Arena arena = {0}; // holds the field of one game, grows to the largest board of the recording
+  long long game = 0;
+  long long mismatched = 0;
+  
+  if (!options->json) printf("game,seed,width,height,mines,actions,ticks,state,recorded_state,3bv,ok\n");
+  while (replay_next_game(&reader)) {
+    ReplayHeader *header = &reader.header;
+    size_t memory = field_memory(header->width, header->height);
+    if (memory > arena.capacity) {
+      arena_free(&arena);
+      arena_init(&arena, memory);
+      }
+    arena_reset(&arena);
+    MineField *field = replay_create_field(header, &arena);
+    ReplayAction action;
+    int actions = 0;
+    int recorded = -1; // stays so if the stream is cut short
+    uint32_t ticks = 0;
+    
+    while (replay_next_action(&reader, &action)) {
+      ticks = action.tick;
+      if (action.action == REPLAY_END) recorded = action.state;
+      else {
+        if (field) replay_apply(field, &action);
+        actions ++;
+        }
+      }
+    
+    // a game there was no memory for does not match, whatever it recorded
+    int state = field ? field_state(field) : -1;
+    int bbbv = field ? field->bbbv : 0;
+    bool ok = field && state == recorded;
+    if (!ok) mismatched ++;
+    if (options->json) {
+      printf("{\"game\": %lld, \"seed\": %llu, \"width\": %d, \"height\": %d, \"mines\": %d, \"actions\": %d, \"ticks\": %u, \"state\": %d, \"recorded_state\": %d, \"3bv\": %d, \"ok\": %s}\n",
+        game, (unsigned long long) header->seed, header->width, header->height, header->n_mines, actions, ticks, state, recorded, bbbv, ok ? "true" : "false");
+      }
+    else {
+      printf("%lld,%llu,%d,%d,%d,%d,%u,%d,%d,%d,%d\n",
+        game, (unsigned long long) header->seed, header->width, header->height, header->n_mines, actions, ticks, state, recorded, bbbv, ok);
+      }
+    if (field) destroy_field(field);
+    game ++;
+    }
+  arena_free(&arena);
+  
+  fprintf(stderr, "%lld games, %lld do not match\n", game, mismatched);
+  return mismatched;
+  }
+
+int main(int argc, char **argv) {
+  SimOptions options = {100000, (int) sysconf(_SC_NPROCESSORS_ONLN), 30, 16, 99, 1, false, false, false, NULL};
+  double density = 0;
+  
+  for (int i=1;i<argc;i++) {
+    if (strcmp(argv[i], "--games") == 0 && i+1 < argc) options.games = atoll(argv[++i]);
+    else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) options.threads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--width") == 0 && i+1 < argc) options.width = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--height") == 0 && i+1 < argc) options.height = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--mines") == 0 && i+1 < argc) options.n_mines = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--density") == 0 && i+1 < argc) density = atof(argv[++i]);
+    else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc) options.seed = strtoull(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--no-guess") == 0) options.no_guess = true;
+    else if (strcmp(argv[i], "--random-opening") == 0) options.random_opening = true;
+    else if (strcmp(argv[i], "--json") == 0) options.json = true;
+    else if (strcmp(argv[i], "--verify") == 0 && i+1 < argc) options.verify = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [--games N] [--threads N] [--width W] [--height H] [--mines N | --density D] [--seed S] [--no-guess] [--random-opening] [--json]\n", argv[0]);
+      fprintf(stderr, "       %s --verify FILE [--json]\n", argv[0]);
+      return 1;
+      }
+    }
+  
+  if (options.verify) {
+    FILE *file = strcmp(options.verify, "-") == 0 ? stdin : fopen(options.verify, "rb");
+    if (!file) {
+      fprintf(stderr, "cannot open %s\n", options.verify);
+      return 1;
+      }
+    long long mismatched = verify_replays(&options, file);
+    if (file != stdin) fclose(file);
+    return mismatched > 0;
+    }
+  
+  if (!field_size_fits(options.width, options.height) || options.games < 0) {
+    fprintf(stderr, "invalid board size or game count\n");
+    return 1;
+    }
+  if (density > 0) options.n_mines = (int) (options.width * options.height * density);
+  if (options.n_mines < 0 || options.n_mines >= options.width * options.height) {
+    fprintf(stderr, "the mines must be fewer than the tiles\n");
+    return 1;
+    }
+  if (options.threads < 1) options.threads = 1;
+  if (options.threads > MAX_THREADS) options.threads = MAX_THREADS;
+  
+  // the games are split evenly up front, stealing evens out boards that take longer
+  Worker *workers = calloc(options.threads, sizeof(Worker));
+  int n_buckets = options.width * options.height < MAX_BUCKETS ? options.width * options.height + 1 : MAX_BUCKETS;
+  Stats total;
+  bool ok = workers && init_stats(&total, n_buckets);
+  for (int t=0;t<options.threads && ok;t++) {
+    if (!init_stats(&workers[t].stats, n_buckets)) ok = false;
+    }
+  if (!ok) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+    }
+  for (int t=0;t<options.threads;t++) {
+    Worker *worker = &workers[t];
+    pthread_mutex_init(&worker->lock, NULL);
+    worker->next = options.games * t / options.threads;
+    worker->end = options.games * (t+1) / options.threads;
+    worker->workers = workers;
+    worker->id = t;
+    worker->options = &options;
+    }
+  
+  long long start = now_ns();
+  for (int t=0;t<options.threads;t++) pthread_create(&workers[t].thread, NULL, run_worker, &workers[t]);
+  for (int t=0;t<options.threads;t++) pthread_join(workers[t].thread, NULL);
+  long long ns = now_ns() - start;
+  
+  for (int t=0;t<options.threads;t++) {
+    merge_stats(&total, &workers[t].stats);
+    free(workers[t].stats.histograms);
+    pthread_mutex_destroy(&workers[t].lock);
+    }
+  bool complete = total.games == options.games;
+  if (complete) print_results(&options, &total, ns);
+  else fprintf(stderr, "out of memory for the fields, %lld of %lld games were played\n", total.games, options.games);
+  
+  free(total.histograms);
+  free(workers);
+  return !complete;
+  }
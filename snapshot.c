@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+
+#ifdef FIELD_MMAP
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+_Static_assert(sizeof(SnapshotHeader) == 128, "the planes that follow the header have to stay aligned");
+
+static size_t tile_bytes(int width, int height, bool packed) {
+  size_t tiles = (size_t) (width + 2) * (height + 2);
+  if (packed) return sizeof(uint64_t) * 3 * ((tiles + 63) / 64);
+  return sizeof(Tile) * tiles;
+  }
+
+// FNV-1a over 64 bit words with the high bits folded back in, so damage anywhere in a word shows
+static uint64_t hash_bytes(uint64_t h, const uint8_t *bytes, size_t n) {
+  for (size_t i=0;i<n;i+=8) {
+    uint64_t word = 0;
+    memcpy(&word, bytes + i, n - i < 8 ? n - i : 8);
+    h = (h ^ word) * 0x100000001B3ull;
+    h ^= h >> 29;
+    }
+  return h;
+  }
+
+// of the header without the checksum itself and the tiles after it
+static uint64_t checksum(const SnapshotHeader *header, const void *tiles) {
+  SnapshotHeader copy = *header;
+  copy.checksum = 0;
+  uint64_t h = hash_bytes(0xCBF29CE484222325ull, (const uint8_t *) &copy, sizeof(SnapshotHeader));
+  return hash_bytes(h, tiles, header->tile_bytes);
+  }
+
+bool take_snapshot(Snapshot *snapshot, MineField *field) {
+  if (!field->generated) return false;
+  size_t bytes = tile_bytes(field->width, field->height, field->packed);
+  if (bytes > snapshot->capacity) {
+    free(snapshot->tiles);
+    snapshot->tiles = malloc(bytes);
+    snapshot->capacity = snapshot->tiles ? bytes : 0;
+    if (!snapshot->tiles) return false;
+    }
+  
+  // the three planes are one block
+  if (field->packed) memcpy(snapshot->tiles, field->mine_bits, bytes);
+  else if (!field->n_regions) memcpy(snapshot->tiles, field->tiles, bytes);
+  else {
+    // the inner tiles of an opened region are revealed in the snapshot, it keeps no regions
+    Tile *tiles = snapshot->tiles;
+    for (size_t i=0;i<bytes;i++) tiles[i] = field_tile(field, i);
+    }
+  
+  snapshot->header = (SnapshotHeader) {
+    .magic = SNAPSHOT_MAGIC,
+    .version = SNAPSHOT_VERSION,
+    .seed = field->seed,
+    .tile_bytes = bytes,
+    .width = field->width,
+    .height = field->height,
+    .n_mines = field->n_mines,
+    .flags = (field->packed ? SNAPSHOT_PACKED : 0) | (field->no_guess ? SNAPSHOT_NO_GUESS : 0),
+    .placed_mines = field->placed_mines,
+    .placed_flags = field->placed_flags,
+    .correct_flags = field->correct_flags,
+    .tiles_unopened = field->tiles_unopened,
+    .bbbv = field->bbbv,
+    .bbbv_left = field->bbbv_left,
+    .state = field->state,
+    .shown = field->shown,
+    .no_guess_attempts = field->no_guess_attempts,
+    };
+  return true;
+  }
+
+bool write_snapshot(Snapshot *snapshot, const char *path) {
+  SnapshotHeader *header = &snapshot->header;
+  header->checksum = checksum(header, snapshot->tiles);
+  
+  char tmp[4096];
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int) sizeof(tmp)) return false;
+  FILE *file = fopen(tmp, "wb");
+  if (!file) return false;
+  
+  bool ok = fwrite(header, sizeof(SnapshotHeader), 1, file) == 1;
+  ok = ok && fwrite(snapshot->tiles, 1, header->tile_bytes, file) == header->tile_bytes;
+  ok = ok && fflush(file) == 0;
+  #ifdef FIELD_MMAP
+  ok = ok && fsync(fileno(file)) == 0; // on the disk before it replaces the last one
+  #endif
+  ok = fclose(file) == 0 && ok;
+  
+  ok = ok && rename(tmp, path) == 0;
+  if (!ok) remove(tmp);
+  return ok;
+  }
+
+void free_snapshot(Snapshot *snapshot) {
+  free(snapshot->tiles);
+  snapshot->tiles = NULL;
+  snapshot->capacity = 0;
+  }
+
+bool save_snapshot(MineField *field, const char *path) {
+  Snapshot snapshot = {0};
+  bool ok = take_snapshot(&snapshot, field) && write_snapshot(&snapshot, path);
+  free_snapshot(&snapshot);
+  return ok;
+  }
+
+static bool valid_header(const SnapshotHeader *header) {
+  if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION) return false;
+  int width = header->width;
+  int height = header->height;
+  if (width < 1 || width > SNAPSHOT_MAX_SIZE || height < 1 || height > SNAPSHOT_MAX_SIZE) return false;
+  if (!field_size_fits(width, height)) return false;
+  if (header->tile_bytes != tile_bytes(width, height, header->flags & SNAPSHOT_PACKED)) return false;
+  
+  if (header->n_mines < 0 || header->n_mines >= (long long) width * height) return false;
+  if (header->state != GAME_PLAYING && header->state != GAME_OVER && header->state != GAME_WON) return false;
+  if (header->shown < SHOW_NONE || header->shown > SHOW_FLAGS) return false;
+  if (header->bbbv < 0 || header->bbbv_left < 0 || header->bbbv_left > header->bbbv) return false;
+  return header->no_guess_attempts >= 0;
+  }
+
+bool read_snapshot_header(const char *path, SnapshotHeader *header) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return false;
+  bool ok = fread(header, sizeof(SnapshotHeader), 1, file) == 1 && valid_header(header);
+  fclose(file);
+  return ok;
+  }
+
+// the tiles of a byte field, as generate_field and the game leave them
+static bool valid_tiles(MineField *field, int counts[4]) {
+  int stride = field->stride;
+  const Tile *tiles = field->tiles;
+  for (int y=0;y<field->height+2;y++) {
+    for (int x=0;x<stride;x++) {
+      int i = y*stride + x;
+      Tile t = tiles[i];
+      if (x == 0 || x == stride-1 || y == 0 || y == field->height+1) {
+        if (t != TILE_BORDER) return false;
+        continue;
+        }
+      
+      if (t & TILE_WFLG) return false;
+      if (IS_FLAG(t) && IS_RVLD(t)) return false;
+      int mines = 0;
+      for (int k=0;k<8;k++) mines += IS_MINE(tiles[i + field->neighbors[k]]) != 0;
+      if (TILE_GET_NUMBER(t) != (IS_MINE(t) ? TILE_INVA : mines)) return false;
+      
+      counts[0] += IS_MINE(t) != 0;
+      counts[1] += IS_FLAG(t) != 0;
+      counts[2] += IS_MINE(t) && IS_FLAG(t);
+      counts[3] += IS_RVLD(t) != 0;
+      }
+    }
+  return true;
+  }
+
+static bool plane_bit(const uint64_t *plane, int i) {
+  return (plane[i >> 6] >> (i & 63)) & 1;
+  }
+
+// the planes of a packed field: every bit outside the field reads as a revealed tile without a mine or a flag
+static bool valid_planes(MineField *field, int counts[4]) {
+  int stride = field->stride;
+  int n_tiles = stride * (field->height + 2);
+  const uint64_t *mines = field->mine_bits;
+  const uint64_t *rvld = field->rvld_bits;
+  const uint64_t *flags = field->flag_bits;
+  
+  int outside = field->n_words*64 - field->width * field->height;
+  for (int i=0;i<field->n_words*64;i++) {
+    int x = i % stride;
+    int y = i / stride;
+    if (i < n_tiles && x != 0 && x != stride-1 && y != 0 && y != field->height+1) {
+      // inside, skips to the end of the row
+      i += field->width - 1;
+      continue;
+      }
+    if (!plane_bit(rvld, i) || plane_bit(mines, i) || plane_bit(flags, i)) return false;
+    }
+  
+  int revealed = 0;
+  for (int w=0;w<field->n_words;w++) {
+    if (flags[w] & rvld[w]) return false;
+    counts[0] += __builtin_popcountll(mines[w]);
+    counts[1] += __builtin_popcountll(flags[w]);
+    counts[2] += __builtin_popcountll(mines[w] & flags[w]);
+    revealed += __builtin_popcountll(rvld[w]);
+    }
+  counts[3] = revealed - outside;
+  return true;
+  }
+
+#ifdef FIELD_MMAP
+// points the planes of a packed field into a private mapping of the file instead of copying it,
+// load_snapshot still reads every page once for the checksum and the checks, a page is copied
+// only when the game writes to it and the file stays as it is
+static bool map_planes(MineField *field, FILE *file, size_t bytes) {
+  struct stat st;
+  int fd = fileno(file);
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size != sizeof(SnapshotHeader) + bytes) return false;
+  void *mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (mapping == MAP_FAILED) return false;
+  
+  free(field->mine_bits);
+  field->mapping = mapping;
+  field->mapping_size = st.st_size;
+  field->mine_bits = (uint64_t *) ((uint8_t *) mapping + sizeof(SnapshotHeader));
+  field->rvld_bits = field->mine_bits + field->n_words;
+  field->flag_bits = field->rvld_bits + field->n_words;
+  return true;
+  }
+#endif
+
+// reads the tiles that follow the header, the file has to end with them
+static bool read_tiles(MineField *field, FILE *file, size_t bytes) {
+  #ifdef FIELD_MMAP
+  if (field->packed) return map_planes(field, file, bytes);
+  #endif
+  void *tiles = field->packed ? (void *) field->mine_bits : (void *) field->tiles;
+  return fread(tiles, 1, bytes, file) == bytes && getc(file) == EOF;
+  }
+
+MineField *load_snapshot(const char *path, Arena *arena) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return NULL;
+  SnapshotHeader header;
+  if (fread(&header, sizeof(SnapshotHeader), 1, file) != 1 || !valid_header(&header)) {
+    fclose(file);
+    return NULL;
+    }
+  
+  size_t used = arena ? arena->used : 0;
+  MineField *field = NULL;
+  if (header.flags & SNAPSHOT_PACKED) field = create_packed_field(header.width, header.height, header.n_mines);
+  else {
+    if (arena) field = create_field_in(arena, header.width, header.height, header.n_mines);
+    if (!field) field = create_field(header.width, header.height, header.n_mines);
+    }
+  if (!field) {
+    fclose(file);
+    return NULL;
+    }
+  
+  bool ok = read_tiles(field, file, header.tile_bytes);
+  fclose(file);
+  
+  const void *tiles = field->packed ? (const void *) field->mine_bits : (const void *) field->tiles;
+  int counts[4] = {0};
+  ok = ok && checksum(&header, tiles) == header.checksum;
+  ok = ok && (field->packed ? valid_planes(field, counts) : valid_tiles(field, counts));
+  ok = ok && counts[0] == header.placed_mines && counts[1] == header.placed_flags && counts[2] == header.correct_flags;
+  ok = ok && header.tiles_unopened == header.width * header.height - counts[3];
+  if (!ok) {
+    destroy_field(field);
+    if (arena) arena->used = used;
+    return NULL;
+    }
+  
+  set_field_seed(field, header.seed);
+  field->no_guess = header.flags & SNAPSHOT_NO_GUESS;
+  field->no_guess_attempts = header.no_guess_attempts;
+  field->generated = true;
+  field->placed_mines = header.placed_mines;
+  field->placed_flags = header.placed_flags;
+  field->correct_flags = header.correct_flags;
+  field->tiles_unopened = header.tiles_unopened;
+  field->bbbv = header.bbbv;
+  field->bbbv_left = header.bbbv_left;
+  field->state = header.state;
+  field->shown = header.shown;
+  return field;
+  }
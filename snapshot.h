@@ -0,0 +1,77 @@
+/*
+  Snapshots of a game in progress: the state of a MineField in one file, to be resumed later.
+  
+  The file is a fixed header followed by the tiles exactly as a field keeps them, the padded
+  tile bytes of a byte field or the three bit planes of a packed one, so loading is a read into
+  the field, or for a packed field a private mapping of the file that the planes point into.
+  Numbers are in the byte order of the machine that wrote it. A checksum of the whole file and a
+  recount of the counters reject a file that was cut short or damaged.
+  
+  A snapshot is written to path.tmp and renamed over path once it is complete, so a crash while
+  saving leaves the previous one. Taking a snapshot copies the tiles, writing it does not touch
+  the field, so the writing can run on another thread than the game.
+  
+  Typical use:
+    save_snapshot(field, path);
+    
+    MineField *field = load_snapshot(path, NULL);  // NULL if there is none or it is broken
+    
+    Snapshot snapshot = {0};
+    take_snapshot(&snapshot, field);  // on the game's thread
+    write_snapshot(&snapshot, path);  // anywhere
+    free_snapshot(&snapshot);
+*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "minefield.h"
+
+#define SNAPSHOT_MAGIC   0x50534E4D // "MNSP" read as a little endian number
+#define SNAPSHOT_VERSION 1
+
+#define SNAPSHOT_PACKED   1
+#define SNAPSHOT_NO_GUESS 2
+
+#define SNAPSHOT_MAX_SIZE 65536 // longest side a header may give, anything larger is a broken file
+
+// 128 bytes, so the tiles that follow it are aligned for the planes of a packed field
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t seed;
+  uint64_t tile_bytes; // what follows the header
+  uint64_t checksum; // of the header, with this field zeroed, and the tiles
+  int32_t width;
+  int32_t height;
+  int32_t n_mines;
+  int32_t flags; // SNAPSHOT_*
+  int32_t placed_mines;
+  int32_t placed_flags;
+  int32_t correct_flags;
+  int32_t tiles_unopened;
+  int32_t bbbv;
+  int32_t bbbv_left;
+  int32_t state;
+  int32_t shown;
+  int32_t no_guess_attempts;
+  int32_t reserved[11];
+  } SnapshotHeader;
+
+typedef struct {
+  SnapshotHeader header;
+  void *tiles;
+  size_t capacity; // of tiles, kept for the next snapshot
+  } Snapshot;
+
+// saving
+bool take_snapshot(Snapshot *snapshot, MineField *field); // false for a field that was not generated yet
+bool write_snapshot(Snapshot *snapshot, const char *path); // computes the checksum, false if the file could not be written
+void free_snapshot(Snapshot *snapshot);
+bool save_snapshot(MineField *field, const char *path);
+
+// loading, a byte field goes in the arena if it fits, packed fields never do
+bool read_snapshot_header(const char *path, SnapshotHeader *header); // false if it is missing or not a snapshot
+MineField *load_snapshot(const char *path, Arena *arena);
+
+#endif
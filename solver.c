@@ -0,0 +1,147 @@
+#include "solver.h"
+
+#define IS_UNKNOWN(t) (!IS_RVLD(t) && !IS_FLAG(t))
+
+// a revealed number and the covered tiles around it
+typedef struct {
+  int unknown[8];
+  int n_unknown;
+  int mines; // mines left among the unknown tiles
+  } Constraint;
+
+// an empty tile is none, the flood revealed everything around it, though the inner tiles of an opened
+// region read as covered here, see field_tile. The tiles around a number read as they are
+static bool get_constraint(MineField *field, int i, Constraint *c) {
+  Tile t = field->tiles[i];
+  if (!IS_RVLD(t) || IS_MINE(t) || IS_EMPTY(t) || t == TILE_BORDER) return false;
+  
+  c->n_unknown = 0;
+  c->mines = TILE_GET_NUMBER(t);
+  for (int k=0;k<8;k++) {
+    int n = i + field->neighbors[k];
+    Tile u = field->tiles[n];
+    if (IS_FLAG(u)) c->mines --;
+    else if (!IS_RVLD(u)) c->unknown[c->n_unknown++] = n;
+    }
+  return c->n_unknown > 0;
+  }
+
+static int open_tile(MineField *field, int i) {
+  if (!IS_UNKNOWN(field_tile(field, i))) return 0;
+  dig_tile(field, i);
+  return 1;
+  }
+
+static int flag_tile(MineField *field, int i) {
+  if (!IS_UNKNOWN(field_tile(field, i))) return 0;
+  flip_flag(field, i % field->stride - 1, i / field->stride - 1);
+  return 1;
+  }
+
+static bool contains(const int *tiles, int n, int tile) {
+  for (int k=0;k<n;k++) if (tiles[k] == tile) return true;
+  return false;
+  }
+
+// a number whose mines are all flagged or whose unknown tiles are all mines
+static int single_rule(MineField *field) {
+  int moves = 0;
+  Constraint a;
+  
+  for (int y=0;y<field->height;y++) {
+    for (int x=0;x<field->width;x++) {
+      if (!get_constraint(field, TILE_INDEX(field, x, y), &a)) continue;
+      
+      if (a.mines == 0) {
+        for (int k=0;k<a.n_unknown;k++) moves += open_tile(field, a.unknown[k]);
+        }
+      else if (a.mines == a.n_unknown) {
+        for (int k=0;k<a.n_unknown;k++) moves += flag_tile(field, a.unknown[k]);
+        }
+      }
+    }
+  return moves;
+  }
+
+// two numbers at most two tiles apart: bounds on the mines they share decide the tiles only b sees
+static int pair_rule(MineField *field) {
+  Constraint a, b;
+  
+  for (int y=0;y<field->height;y++) {
+    for (int x=0;x<field->width;x++) {
+      int i = TILE_INDEX(field, x, y);
+      if (!get_constraint(field, i, &a)) continue;
+      
+      for (int dy=-2;dy<=2;dy++) {
+        for (int dx=-2;dx<=2;dx++) {
+          if (dx == 0 && dy == 0) continue;
+          if (!IN_FIELD(x+dx, y+dy, field)) continue;
+          if (!get_constraint(field, i + dy*field->stride + dx, &b)) continue;
+          
+          int only_b[8];
+          int n_only_b = 0;
+          for (int k=0;k<b.n_unknown;k++) {
+            if (!contains(a.unknown, a.n_unknown, b.unknown[k])) only_b[n_only_b++] = b.unknown[k];
+            }
+          if (n_only_b == 0) continue;
+          
+          int common = b.n_unknown - n_only_b;
+          int n_only_a = a.n_unknown - common;
+          if (common == 0) continue;
+          
+          int min_common = 0;
+          if (a.mines - n_only_a > min_common) min_common = a.mines - n_only_a;
+          if (b.mines - n_only_b > min_common) min_common = b.mines - n_only_b;
+          int max_common = common;
+          if (a.mines < max_common) max_common = a.mines;
+          if (b.mines < max_common) max_common = b.mines;
+          if (min_common > max_common) continue; // wrong flags
+          
+          int moves = 0;
+          if (b.mines - min_common == 0) {
+            for (int k=0;k<n_only_b;k++) moves += open_tile(field, only_b[k]);
+            }
+          else if (b.mines - max_common == n_only_b) {
+            for (int k=0;k<n_only_b;k++) moves += flag_tile(field, only_b[k]);
+            }
+          if (moves) return moves;
+          }
+        }
+      }
+    }
+  return 0;
+  }
+
+// all mines flagged or every covered tile is a mine
+static int count_rule(MineField *field) {
+  int mines_left = field->placed_mines - field->placed_flags;
+  int unknown = field->tiles_unopened - field->placed_flags;
+  if (unknown == 0) return 0;
+  if (mines_left != 0 && mines_left != unknown) return 0;
+  
+  int moves = 0;
+  for (int y=0;y<field->height;y++) {
+    for (int x=0;x<field->width;x++) {
+      int i = TILE_INDEX(field, x, y);
+      if (mines_left == 0) moves += open_tile(field, i);
+      else moves += flag_tile(field, i);
+      }
+    }
+  return moves;
+  }
+
+int solver_step(MineField *field) {
+  int moves = single_rule(field);
+  if (moves) return moves;
+  moves = pair_rule(field);
+  if (moves) return moves;
+  return count_rule(field);
+  }
+
+bool solve_field(MineField *field, int x, int y) {
+  if (dig(field, x, y)) return false;
+  while (field->tiles_unopened > field->placed_mines) {
+    if (solver_step(field) == 0) return false;
+    }
+  return true;
+  }
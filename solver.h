@@ -0,0 +1,18 @@
+/*
+  A deterministic minesweeper solver, it only makes moves that are certain.
+  Used by the engine to generate boards that can be solved without guessing.
+*/
+
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include "minefield.h"
+
+// applies every certain move it can find: opens safe tiles and flags mines,
+// returns the number of tiles it opened or flagged, 0 if a guess is needed
+int solver_step(MineField *field);
+
+// opens (x, y) and keeps stepping, returns true if the whole board got solved without a guess
+bool solve_field(MineField *field, int x, int y);
+
+#endif